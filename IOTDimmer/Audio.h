@@ -0,0 +1,65 @@
+/*
+ * IOTDimmer - Audio
+ * Light organ: band energy of sampled audio as effect input
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Audio_h
+#define Audio_h
+
+#if defined(AUDIO_PIN)
+#if defined(ARDUINO_ARCH_AVR)
+#error AUDIO_PIN is only available on ESP32
+#endif
+#include "driver/adc.h"       // continuous sampling by the adc dma controller
+#endif
+
+#define AUDIO_RATE          8000  // [Hz] sample rate
+#define AUDIO_BLOCK         80    // samples per band energy block, 10 ms = one half cycle at 50 Hz
+#define AUDIO_DMA_BUFFER    1024  // [bytes] dma ring buffer, about 60 ms of samples
+#define AUDIO_COEFF_SHIFT   14    // goertzel coefficient 2*cos(w) is Q14
+#define AUDIO_ENV_FRAC      4     // fixed point fraction bits of the envelope
+#define AUDIO_ATTACK_SHIFT  1     // envelope follows rising energy with 1/2 per block
+#define AUDIO_RELEASE_SHIFT 4     // and decays with 1/16 per block
+
+#define AUDIO_BANDS         3
+#ifndef AUDIO_BAND_HZ
+#define AUDIO_BAND_HZ       {125, 500, 2000} // [Hz] bass, mid, treble
+#endif
+
+const unsigned short audioBands[AUDIO_BANDS] = AUDIO_BAND_HZ;
+
+#if defined(AUDIO_PIN)
+#if CONFIG_IDF_TARGET_ESP32
+#define AUDIO_FORMAT        ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define AUDIO_SAMPLE(d)     ((d).type1.data)
+#else
+#define AUDIO_FORMAT        ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define AUDIO_SAMPLE(d)     ((d).type2.data)
+#endif
+#endif
+
+class CAudio {
+public:
+  CAudio(); // constructor
+  void init();
+  void handle();
+  void process(const short *samples, unsigned short n); // one block of raw samples, also for synthetic buffers
+  long getBand(byte band);  // [adc units] envelope of band amplitude
+  long getLevel();          // [adc units] sum of band envelopes, the effect input
+private:
+  static unsigned long isqrt(unsigned long long value);
+  long coeff[AUDIO_BANDS];  // [Q14] 2*cos(2*PI*f/fs)
+  long envelope[AUDIO_BANDS]; // [adc units << AUDIO_ENV_FRAC]
+  short block[AUDIO_BLOCK];
+  unsigned short blockFill;
+  bool updated;
+  bool enabled;
+};
+
+extern CAudio audio;
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * IOTDimmer - Audio
+ * Light organ: band energy of sampled audio as effect input
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "Audio.h"
+#include "Curves.h"
+
+CAudio::CAudio() { // constructor
+  for (byte b = 0; b < AUDIO_BANDS; b++) {
+    coeff[b] = 0;
+    envelope[b] = 0;
+  }
+  blockFill = 0;
+  updated = false;
+  enabled = false;
+}
+
+void CAudio::init() {
+  for (byte b = 0; b < AUDIO_BANDS; b++) { // cos(w) in Q15 is 2*cos(w) in Q14
+    coeff[b] = CCurves::sine(((unsigned long)audioBands[b]*PHASE_ONE)/AUDIO_RATE + PHASE_ONE/4);
+    envelope[b] = 0;
+  }
+  blockFill = 0;
+  updated = false;
+#if defined(AUDIO_PIN)
+  adc_digi_init_config_t initConfig = {};
+  adc_digi_pattern_config_t pattern = {};
+  adc_digi_configuration_t config = {};
+  int channel = digitalPinToAnalogChannel(AUDIO_PIN);
+
+  if (channel < 0) {
+    logger.printf(LOG_WAVEFORM, "Audio pin has no adc channel");
+    return;
+  }
+  initConfig.max_store_buf_size = AUDIO_DMA_BUFFER;
+  initConfig.conv_num_each_intr = AUDIO_BLOCK*sizeof(adc_digi_output_data_t);
+  initConfig.adc1_chan_mask = BIT(channel);
+  pattern.atten = ADC_ATTEN_DB_11;
+  pattern.channel = channel;
+  pattern.unit = 0;
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+#if CONFIG_IDF_TARGET_ESP32
+  config.conv_limit_en = true;
+#else
+  config.conv_limit_en = false;
+#endif
+  config.conv_limit_num = 250;
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = AUDIO_RATE;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = AUDIO_FORMAT;
+  enabled = (adc_digi_initialize(&initConfig) == ESP_OK) && (adc_digi_controller_configure(&config) == ESP_OK) && (adc_digi_start() == ESP_OK);
+  logger.printf(LOG_WAVEFORM, enabled ? "Audio sampling started" : "Audio sampling failed");
+#endif
+}
+
+void CAudio::handle() { // every half cycle from the waveform engine
+#if defined(AUDIO_PIN)
+  adc_digi_output_data_t data[AUDIO_BLOCK];
+  uint32_t length = 0;
+
+  if (!enabled) {
+    return;
+  }
+  while ((adc_digi_read_bytes((uint8_t *)data, sizeof(data), &length, 0) == ESP_OK) && (length > 0)) {
+    for (uint32_t i = 0; i < length/sizeof(adc_digi_output_data_t); i++) {
+      block[blockFill++] = AUDIO_SAMPLE(data[i]);
+      if (blockFill >= AUDIO_BLOCK) {
+        process(block, AUDIO_BLOCK);
+        blockFill = 0;
+      }
+    }
+  }
+#endif
+  if (updated) {
+    updated = false;
+    for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+      waveforms[ch].streamInput((int)getLevel());
+    }
+  }
+}
+
+void CAudio::process(const short *samples, unsigned short n) {
+  long mean = 0;
+
+  if (n == 0) {
+    return;
+  }
+  for (unsigned short i = 0; i < n; i++) {
+    mean += samples[i];
+  }
+  mean /= n;
+  for (byte b = 0; b < AUDIO_BANDS; b++) { // goertzel filter per band
+    long s1 = 0;
+    long s2 = 0;
+    for (unsigned short i = 0; i < n; i++) {
+      long s = (samples[i] - mean) + (long)(((long long)coeff[b]*s1) >> AUDIO_COEFF_SHIFT) - s2;
+      s2 = s1;
+      s1 = s;
+    }
+    long long power = (long long)s1*s1 + (long long)s2*s2 - ((((long long)coeff[b]*s1) >> AUDIO_COEFF_SHIFT)*s2);
+    long amplitude = (long)(((unsigned long long)isqrt(power > 0 ? power : 0) << (AUDIO_ENV_FRAC + 1))/n);
+    if (amplitude > envelope[b]) {
+      envelope[b] += (amplitude - envelope[b]) >> AUDIO_ATTACK_SHIFT;
+    } else {
+      envelope[b] -= (envelope[b] - amplitude) >> AUDIO_RELEASE_SHIFT;
+    }
+  }
+  updated = true;
+}
+
+long CAudio::getBand(byte band) {
+  if (band >= AUDIO_BANDS) {
+    return 0;
+  }
+  return envelope[band] >> AUDIO_ENV_FRAC;
+}
+
+long CAudio::getLevel() {
+  long level = 0;
+  for (byte b = 0; b < AUDIO_BANDS; b++) {
+    level += envelope[b];
+  }
+  return level >> AUDIO_ENV_FRAC;
+}
+
+// Privates !!!!!!!!!!!!!
+
+unsigned long CAudio::isqrt(unsigned long long value) {
+  unsigned long long root = 0;
+  unsigned long long bit = 1ULL << 62;
+
+  while (bit > value) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (unsigned long)root;
+}
+
+CAudio audio;
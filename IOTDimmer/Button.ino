@@ -77,6 +77,7 @@ void CButton::handleButton() {
       break;
     case reset:
       logger.printf(LOG_BUTTON, "System reset");
+      settings.flush();
       ESP.restart();
       break;
   }  
@@ -0,0 +1,36 @@
+/*
+ * IOTDimmer - Curves
+ * Fixed point curves for fades and effects
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Curves_h
+#define Curves_h
+
+#define CURVE_STEPS  64      // quarter sine table steps, linear interpolation in between
+#define CURVE_SHIFT  15      // curves are Q15
+#define CURVE_ONE    (1L << CURVE_SHIFT)
+#define PHASE_ONE    65536UL // phase of a quarter (quarter, ease) or a period (sine)
+
+// compile time sine for the table, Taylor series on [0..PI/2]
+constexpr double curveSinTerms(double x2, double term, double sum, int n) {
+  return (n > 10) ? sum : curveSinTerms(x2, -term*x2/((2*n)*(2*n+1)), sum - term*x2/((2*n)*(2*n+1)), n+1);
+}
+constexpr double curveSin(double x) {
+  return curveSinTerms(x*x, x, x, 1);
+}
+constexpr unsigned short curveQ15(int i) {
+  return (unsigned short)(curveSin((M_PI/2)*i/CURVE_STEPS)*CURVE_ONE + 0.5);
+}
+
+class CCurves {
+public:
+  static long IRAM_ATTR quarter(unsigned long phase); // sin(PI/2*x), [0..CURVE_ONE]
+  static long IRAM_ATTR ease(unsigned long phase);    // (1-cos(PI*x))/2, [0..CURVE_ONE]
+  static long IRAM_ATTR sine(unsigned long phase);    // sin(2*PI*x), [-CURVE_ONE..CURVE_ONE]
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * IOTDimmer - Curves
+ * Fixed point curves for fades and effects
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "Curves.h"
+
+#define CURVE_Q15_4(i)  curveQ15(i), curveQ15(i+1), curveQ15(i+2), curveQ15(i+3)
+#define CURVE_Q15_16(i) CURVE_Q15_4(i), CURVE_Q15_4(i+4), CURVE_Q15_4(i+8), CURVE_Q15_4(i+12)
+
+// generated by the compiler, in DRAM as the triac isr uses it
+const unsigned short DRAM_ATTR curveTable[CURVE_STEPS+1] = {CURVE_Q15_16(0), CURVE_Q15_16(16), CURVE_Q15_16(32), CURVE_Q15_16(48), curveQ15(CURVE_STEPS)};
+
+static_assert(curveQ15(CURVE_STEPS) == CURVE_ONE, "Quarter sine table must end at 1.0");
+
+long IRAM_ATTR CCurves::quarter(unsigned long phase) {
+  if (phase >= PHASE_ONE) {
+    return CURVE_ONE;
+  }
+  unsigned long i = phase / (PHASE_ONE/CURVE_STEPS);
+  long frac = phase % (PHASE_ONE/CURVE_STEPS);
+  return curveTable[i] + ((((long)curveTable[i+1] - curveTable[i]) * frac) / (long)(PHASE_ONE/CURVE_STEPS));
+}
+
+long IRAM_ATTR CCurves::ease(unsigned long phase) {
+  long q = quarter(phase);
+  return (q*q) >> CURVE_SHIFT; // (1-cos(PI*x))/2 = sin(PI*x/2)^2
+}
+
+long IRAM_ATTR CCurves::sine(unsigned long phase) {
+  unsigned long part = (phase % PHASE_ONE) * 4; // phase in quadrant
+  byte quadrant = part / PHASE_ONE;
+  part %= PHASE_ONE;
+  switch (quadrant) {
+    case 0:  return quarter(part);
+    case 1:  return quarter(PHASE_ONE - part);
+    case 2:  return -quarter(part);
+    default: return -quarter(PHASE_ONE - part);
+  }
+}
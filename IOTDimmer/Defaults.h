@@ -48,4 +48,9 @@
 #define DEF_HADISCO             false
 #define DEF_HATOPIC             "homeassistant"
 
+#define DEF_LAMP_CURVE          0   // linear
+#define DEF_LAMP_MIN            0   //[%]
+#define DEF_LAMP_MAX            100 //[%]
+#define DEF_LAMP_POINTS         "\x00\x0c\x19\x25\x32\x3e\x4b\x57\x64" // linear, 0, 12 .. 100 [%]
+
 #endif
@@ -0,0 +1,56 @@
+/*
+ * IOTDimmer - Diag
+ * Latency and jitter histograms of the triac interrupts
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Diag_h
+#define Diag_h
+
+#include "Json.h"
+
+#define DIAG_BUCKETS   16     // bucket 0 = 0, bucket n = [2^(n-1) .. 2^n-1], last bucket is open ended
+#define DIAG_PUBLISH   60     // publish histograms on mqtt every 60 status updates (1 minute)
+
+#if defined(ARDUINO_ARCH_AVR)
+#define DIAG_CYCLES()  0UL
+#else
+#define DIAG_CYCLES()  ESP.getCycleCount()
+#endif
+
+const char diag_topic[] = "diag"; // histograms published as maintopic/diag/<name>
+
+class CDiag {
+public:
+  enum histid {zerolatency = 0, // [us] zero cross edge to isr (only with ZERO_CAPTURE)
+               zerojitter = 1,  // [us] edge distance to pll prediction
+               triggerlate = 2, // [us] trigger event later than scheduled
+               extcycles = 3,   // [cycles] zero cross isr execution
+               timercycles = 4, // [cycles] timer isr execution
+               rearmcycles = 5, // [cycles] hardware timer re-arm
+               streamdelay = 6, // [us] udp input sample arrival to playout
+               histnr = 7};
+  CDiag(); // constructor
+  static void IRAM_ATTR record(histid id, unsigned long value);
+  void reset();
+  String getName(byte id);
+  String getJson(byte id);
+  String getJson();
+  struct histogram {
+    unsigned long bucket[DIAG_BUCKETS];
+    unsigned long count;
+    unsigned long max;
+  };
+  void getHistogram(byte id, histogram &hist); // copy, consistent with the isr
+private:
+  void buildJson(byte id, JSON &jString);
+  static portMUX_TYPE mux;
+  volatile static histogram histograms[histnr];
+};
+
+extern CDiag diag;
+
+#endif
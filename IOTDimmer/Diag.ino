@@ -0,0 +1,95 @@
+/*
+ * IOTDimmer - Diag
+ * Latency and jitter histograms of the triac interrupts
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "Diag.h"
+
+portMUX_TYPE CDiag::mux = portMUX_INITIALIZER_UNLOCKED;
+volatile CDiag::histogram CDiag::histograms[CDiag::histnr] = {};
+
+const char *diag_names[CDiag::histnr] = {"zerolatency", "zerojitter", "triggerlate", "extcycles", "timercycles", "rearmcycles", "streamdelay"};
+
+CDiag::CDiag() { // constructor
+}
+
+void IRAM_ATTR CDiag::record(histid id, unsigned long value) {
+  byte i = 0;
+  if (value > 0) {
+    i = 32 - __builtin_clz(value);
+    if (i >= DIAG_BUCKETS) {
+      i = DIAG_BUCKETS - 1;
+    }
+  }
+  portENTER_CRITICAL_ISR(&mux);
+  histograms[id].bucket[i]++;
+  histograms[id].count++;
+  if (value > histograms[id].max) {
+    histograms[id].max = value;
+  }
+  portEXIT_CRITICAL_ISR(&mux);
+}
+
+void CDiag::reset() {
+  portENTER_CRITICAL(&mux);
+  for (byte id = 0; id < histnr; id++) {
+    for (byte i = 0; i < DIAG_BUCKETS; i++) {
+      histograms[id].bucket[i] = 0;
+    }
+    histograms[id].count = 0;
+    histograms[id].max = 0;
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+String CDiag::getName(byte id) {
+  if (id < histnr) {
+    return diag_names[id];
+  }
+  return "";
+}
+
+String CDiag::getJson(byte id) {
+  JSON jString;
+  if (id >= histnr) {
+    return "";
+  }
+  buildJson(id, jString);
+  return jString.GetJson();
+}
+
+String CDiag::getJson() {
+  JSON jString;
+  for (byte id = 0; id < histnr; id++) {
+    JSON jHist;
+    buildJson(id, jHist);
+    jString.AddItem(getName(id), jHist);
+  }
+  return jString.GetJson();
+}
+
+void CDiag::getHistogram(byte id, histogram &hist) {
+  portENTER_CRITICAL(&mux);
+  for (byte i = 0; i < DIAG_BUCKETS; i++) {
+    hist.bucket[i] = histograms[id].bucket[i];
+  }
+  hist.count = histograms[id].count;
+  hist.max = histograms[id].max;
+  portEXIT_CRITICAL(&mux);
+}
+
+// Privates !!!!!!!!!!!!!
+
+void CDiag::buildJson(byte id, JSON &jString) {
+  histogram hist;
+  getHistogram(id, hist);
+  jString.AddItem("count", (int)hist.count);
+  jString.AddItem("max", (int)hist.max);
+  jString.AddArray("buckets", hist.bucket, DIAG_BUCKETS);
+}
+
+CDiag diag;
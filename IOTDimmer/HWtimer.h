@@ -27,6 +27,7 @@
 
 #define TIMER1_RESOLUTION 65536UL  // Timer1 is 16 bit
 #define TMR_OFF_TIME_US   50UL
+#define TMR_CLOCK_MHZ     (F_CPU/1000000UL)
 #elif defined(ARDUINO_ARCH_ESP8266)
 #define TMR_PRESC_DIV1    TIM_DIV1
 #define TMR_PRESC_DIV16   TIM_DIV16
@@ -36,6 +37,7 @@
 #define TMR_LOOP          TIM_LOOP
 
 #define TIMER1_RESOLUTION 8388607UL  // Timer1 is 23 bit
+#define TMR_CLOCK_MHZ     (F_CPU/1000000UL)
 #elif defined(ARDUINO_ARCH_ESP32)
 #define TMR_PRESC_MIN     2
 #define TMR_PRESC_DIV80   80
@@ -44,6 +46,7 @@
 #define TMR_PRESC_US      TMR_PRESC_DIV80
 #define TMR_PRESC_10US    TMR_PRESC_DIV800
 #define TMR_PRESC_100US   TMR_PRESC_DIV8000
+#define TMR_CLOCK_MHZ     80UL // APB clock
 
 #define TMR_SINGLE        false
 #define TMR_LOOP          true
@@ -65,6 +68,8 @@ public:
   void disablereset();
   void trigger(unsigned long utime);
   void update(unsigned long utime); // same as trigger, but doesn't enable
+  void triggerTicks(unsigned long ticks); // timer ticks, no conversion, see CHwTimerFixed
+  void updateTicks(unsigned long ticks);
   void attachInterrupt(void (*userFunc)());
   void detachInterrupt();
   unsigned long getuTime();
@@ -73,10 +78,53 @@ private:
   byte prescalerbits;
   byte timer_reload;
   bool timer_enabled;
-#if defined(ARDUINO_ARCH_ESP32)
+#if defined(ARDUINO_ARCH_AVR)
+  unsigned long offticks;
+#elif defined(ARDUINO_ARCH_ESP32)
   hw_timer_t *timer;
-  unsigned long utimex;
+  unsigned long alarmx;
+#endif
+};
+
+// Compile time prescaler and us to ticks conversion for a fixed maximum time,
+// init with divider() and use ticks() with triggerTicks() in interrupts
+template <unsigned long UMAXTIME>
+class CHwTimerFixed {
+public:
+#if   defined(ARDUINO_ARCH_AVR)
+  static constexpr unsigned short division() {
+    return ((TMR_CLOCK_MHZ*UMAXTIME) < TIMER1_RESOLUTION) ? 1 :
+           ((TMR_CLOCK_MHZ*UMAXTIME)/8 < TIMER1_RESOLUTION) ? 8 :
+           ((TMR_CLOCK_MHZ*UMAXTIME)/64 < TIMER1_RESOLUTION) ? 64 :
+           ((TMR_CLOCK_MHZ*UMAXTIME)/256 < TIMER1_RESOLUTION) ? 256 : 1024;
+  }
+  static constexpr unsigned short divider() {
+    return (division() == 1) ? TMR_PRESC_DIV1 : (division() == 8) ? TMR_PRESC_DIV8 :
+           (division() == 64) ? TMR_PRESC_DIV64 : (division() == 256) ? TMR_PRESC_DIV256 : TMR_PRESC_DIV1024;
+  }
+#elif defined(ARDUINO_ARCH_ESP8266)
+  static constexpr unsigned short division() {
+    return ((TMR_CLOCK_MHZ*UMAXTIME) < TIMER1_RESOLUTION) ? 1 :
+           ((TMR_CLOCK_MHZ*UMAXTIME)/16 < TIMER1_RESOLUTION) ? 16 : 256;
+  }
+  static constexpr unsigned short divider() {
+    return (division() == 1) ? TMR_PRESC_DIV1 : (division() == 16) ? TMR_PRESC_DIV16 : TMR_PRESC_DIV256;
+  }
+#elif defined(ARDUINO_ARCH_ESP32)
+  static constexpr unsigned short division() { // same as getPrescaler()
+    return (UMAXTIME == 0) ? TMR_PRESC_US :
+           (UMAXTIME > (TIMER0_RESOLUTION/TMR_PRESC_US)*TMR_PRESC_MIN) ? (unsigned short)(UMAXTIME/(TIMER0_RESOLUTION/TMR_PRESC_US)) + 1 :
+           TMR_PRESC_MIN;
+  }
+  static constexpr unsigned short divider() {
+    return division();
+  }
 #endif
+  static inline unsigned long ticks(unsigned long utime) { // folds to a multiply or shift
+    return ((TMR_CLOCK_MHZ % division()) == 0) ? utime*(TMR_CLOCK_MHZ/division()) :
+           ((division() % TMR_CLOCK_MHZ) == 0) ? utime/(division()/TMR_CLOCK_MHZ) :
+           (unsigned long)((((uint64_t)utime)*((TMR_CLOCK_MHZ << 16)/division())) >> 16);
+  }
 };
 
 extern CHwTimer hwtimer;
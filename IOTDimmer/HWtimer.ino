@@ -8,15 +8,18 @@
  */
 
 #include "HWtimer.h"
+#include "Diag.h"
 
 CHwTimer::CHwTimer() { // constructor
   prescalerbits = 0;
   prescaler = 1;
   timer_reload = TMR_LOOP;
   timer_enabled = false;
-#if defined(ARDUINO_ARCH_ESP32)
+#if defined(ARDUINO_ARCH_AVR)
+  offticks = 0;
+#elif defined(ARDUINO_ARCH_ESP32)
   timer = NULL;
-  utimex = 0;
+  alarmx = 0;
 #endif
 }
 
@@ -30,6 +33,13 @@ void CHwTimer::trigger(unsigned long utime) {
   enable();
 }
 
+void CHwTimer::triggerTicks(unsigned long ticks) {
+  unsigned long cycles = DIAG_CYCLES();
+  updateTicks(ticks);
+  enable();
+  CDiag::record(CDiag::rearmcycles, DIAG_CYCLES() - cycles);
+}
+
 #if   defined(ARDUINO_ARCH_AVR)
 static volatile void (*user_cb)(void);
 static volatile bool single = false;
@@ -49,6 +59,7 @@ void CHwTimer::init(unsigned short divider, byte reload) {
   }
   timer_reload = reload;
   single = (reload == TMR_SINGLE);
+  offticks = ((F_CPU/100000)*TMR_OFF_TIME_US)/(prescaler*10);
   TCCR1A = 0;
   TCCR1B = _BV(WGM12);
   OCR1A = 0;
@@ -100,6 +111,13 @@ void CHwTimer::update(unsigned long utime) {
   }
 }
 
+void CHwTimer::updateTicks(unsigned long ticks) {
+  if (single) {
+    ticks -= offticks;
+  }
+  OCR1A = (unsigned short)(ticks - 1);
+}
+
 unsigned long CHwTimer::getuTime() {
   return ((unsigned long)TCNT1)*(prescaler*10)/(F_CPU/100000);;
 }
@@ -172,6 +190,10 @@ void CHwTimer::update(unsigned long utime) {
   timer1_write(((F_CPU/100000)*utime)/(prescaler*10) - 1);
 }
 
+void CHwTimer::updateTicks(unsigned long ticks) {
+  timer1_write(ticks - 1);
+}
+
 unsigned long CHwTimer::getuTime() {
   return timer1_read()*(prescaler*10)/(F_CPU/100000);
 }
@@ -222,18 +244,15 @@ void CHwTimer::reset() {
 }
 
 void CHwTimer::update(unsigned long utime) {
-  if (utime == utimex) { // overcome bug that not allows to enter same time value twice
-    if (utime > 0) {
-      utimex = utime - 1;
-    } else {
-      utimex = 1;
-    }
-  } else {
-    utimex = utime;
-  }
-  uint64_t ticks = (((uint64_t)utimex)*TMR_PRESC_US/prescaler)-1;
+  updateTicks((unsigned long)(((uint64_t)utime)*TMR_PRESC_US/prescaler));
+}
+
+void CHwTimer::updateTicks(unsigned long ticks) {
+  unsigned long alarm = ticks - (ticks != 0);
+  alarm ^= (alarm == alarmx); // overcome bug that not allows to enter same alarm value twice, move one tick
+  alarmx = alarm;
   reset();
-  timerAlarmWrite(timer, ticks, timer_reload);
+  timerAlarmWrite(timer, alarm, timer_reload);
 }
 
 unsigned long CHwTimer::getuTime() {
@@ -16,6 +16,13 @@
 #define SEED_PIN          3 // ADC1_CH2 // keep
 #define ZEROCROSS_PIN     5 // GPIO5 //interrupt
 #define TRIGGER_PIN      33 // GPIO33
+//#define TRIAC_CHANNELS    2 // more dimmer channels on the same zero cross input
+//#define TRIGGER_PINS      {TRIGGER_PIN, 34} // GPIO33, GPIO34
+//#define TRIAC_USE_RMT       // trigger pulses timed by the RMT peripheral instead of two timer interrupts
+//#define ZERO_CAPTURE        // timestamp zero crossings in hardware (mcpwm capture, cycle counter if not available)
+//#define AUDIO_PIN         4 // ADC1_CH3 // light organ audio input, sampled by adc dma
+//#define STREAM_PORT    4210 // udp input stream for the input effect
+//#define NOISE_SEED     1234 // fixed seed for the random and candle effects, reproducible flicker
 
 #include "udplogger.h"
 #include "IOTWifi.h"
@@ -25,16 +32,31 @@
 #include "Button.h"
 #include "Settings.h"
 #include "Triac.h"
+#include "Diag.h"
+#include "Curves.h"
+#include "Noise.h"
+#include "Lamp.h"
 #include "Waveform.h"
+#include "Scene.h"
+#include "Audio.h"
+#include "InputStream.h"
 #include "Clock.h"
+#include "LastState.h"
 #include "mqtt.h"
 
 void setup() {
   settings.init();
   LED.init();
   button.init();
+  lamp.init();
   triac.init();
-  waveform.init();
+  scene.init();
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    waveforms[ch].init(ch);
+  }
+  lastState.init();
+  audio.init();
+  CWaveform::startEngine();
   iotWifi.init();
   webServer.init();
   Clock.init();
@@ -43,12 +65,14 @@ void setup() {
 }
 
 void loop() {
+  settings.handle();
   LED.handle();
   button.handle();
   triac.handle();
-  waveform.handle();
+  lastState.handle();
   iotWifi.handle();
   webServer.handle();
+  inputStream.handle();
   Clock.handle();
   mqtt.handle();
   chiller.handle(); 
@@ -46,6 +46,7 @@ void cIOTWifi::handle() {
     if (status != s) { // WLAN status change
       if (s == WL_CONNECTED) {
         logger.connect();
+        inputStream.connect();
         logger.printf("Wifi connection successfully established");
         logger.printf("Wifi connected to SSID: " + String(ssid));
         logger.printf("Wifi IP address: " + String(WiFi.localIP().toString()));
@@ -76,6 +77,7 @@ void cIOTWifi::handle() {
         LED.WifiNC();
         connected = false;
         logger.disconnect();
+        inputStream.disconnect();
         if (status == WL_CONNECTED) {
           MDNS.end();
         }
@@ -0,0 +1,30 @@
+/*
+ * IOTDimmer - Ignition
+ * Ignition time table for one mains period and dim mode
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Ignition_h
+#define Ignition_h
+
+/* One entry per percentage, interpolated in between for 16 bit levels. The float work
+ * (acos for power mode) is done once in build(), both directions are integer lookups.
+ */
+class CIgnition {
+public:
+  CIgnition(); // constructor
+  void build(unsigned long izeroTime, byte imode, bool power, const long *output); // output [Q15] per percentage
+  unsigned long getTime(unsigned short level);    // [us] ignition time for level [LEVEL_ON]
+  unsigned short getLevel(unsigned long ignTime); // [LEVEL_ON] level for ignition time [us]
+  unsigned long getZeroTime();                    // [us] built for, 0 = not built
+  byte getMode();
+private:
+  unsigned short time[PWR_ON+1]; // [us] descending
+  unsigned long zeroTime;
+  byte mode;
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * IOTDimmer - Ignition
+ * Ignition time table for one mains period and dim mode
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include <math.h>
+#include "Ignition.h"
+
+CIgnition::CIgnition() { // constructor
+  for (byte i = 0; i <= PWR_ON; i++) {
+    time[i] = 0;
+  }
+  zeroTime = 0;
+  mode = 0;
+}
+
+void CIgnition::build(unsigned long izeroTime, byte imode, bool power, const long *output) {
+  // only place where floats are used, the lamp curve is in output so it costs nothing per half cycle
+  for (int i = PWR_OFF; i <= PWR_ON; i++) {
+    double out = (double)output[i] / CURVE_ONE;
+    if (!power) { // timed
+      time[i] = (unsigned short)round(izeroTime*(1.0 - out));
+    } else { // power, acos(2*output - 1)/(2*PI*freq) = acos(2*output - 1)*zeroTime/PI
+      time[i] = (unsigned short)round((acos(2.0*out - 1.0) * izeroTime) / M_PI);
+    }
+  }
+  zeroTime = izeroTime;
+  mode = imode;
+}
+
+unsigned long CIgnition::getTime(unsigned short level) { // interpolated between percentages
+  unsigned long pos = (unsigned long)level*PWR_ON;
+  byte i = pos/LEVEL_ON;
+  unsigned long frac = pos%LEVEL_ON;
+  if (i >= PWR_ON) {
+    return time[PWR_ON];
+  }
+  return time[i] - ((((unsigned long)time[i] - time[i+1])*frac + LEVEL_ON/2)/LEVEL_ON);
+}
+
+unsigned short CIgnition::getLevel(unsigned long ignTime) {
+  // table is descending, find the enclosing entries by bisection and interpolate
+  byte lo = PWR_OFF;
+  byte hi = PWR_ON;
+  while ((hi - lo) > 1) {
+    byte mid = (lo + hi) / 2;
+    if (time[mid] > ignTime) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  if (ignTime >= time[lo]) {
+    return LEVEL_PERCENT(lo);
+  }
+  if (ignTime <= time[hi]) {
+    return LEVEL_PERCENT(hi);
+  }
+  unsigned long span = time[lo] - time[hi];
+  unsigned long frac = time[lo] - ignTime;
+  return (unsigned short)((((unsigned long long)lo*span + frac)*LEVEL_ON + (PWR_ON*span)/2)/(PWR_ON*span));
+}
+
+unsigned long CIgnition::getZeroTime() {
+  return zeroTime;
+}
+
+byte CIgnition::getMode() {
+  return mode;
+}
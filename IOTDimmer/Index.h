@@ -248,7 +248,8 @@ const char webHome[] = R"literal(
         <option value="1">Ramp</option>
         <option value="2">Sine</option>
         <option value="3">Random</option>
-        <option value="4">Input</option>      
+        <option value="4">Input</option>
+        <option value="5">Candle</option>      
       </select>
       <span></span>
       <label>Input</label>
@@ -785,7 +786,8 @@ const char webDimmer[] = R"literal(
         <option value="1">Ramp</option>
         <option value="2">Sine</option>
         <option value="3">Random</option>
-        <option value="4">Input</option>      
+        <option value="4">Input</option>
+        <option value="5">Candle</option>      
       </select>
       <span></span>
       <label>Effect magnitude</label>
@@ -802,6 +804,7 @@ const char webDimmer[] = R"literal(
       <select name="triacmode">
         <option value="0">Timed</option>
         <option value="1">Power</option>
+        <option value="2">Burst</option>
       </select>
       <span></span>
       <label>Level off</label>
@@ -813,6 +816,24 @@ const char webDimmer[] = R"literal(
       <label>Level lounge</label>
       <input type="number" min=0 max=100 step=1 onchange="checkLimits(this);" name="levellounge"></input>
       <span>%</span>
+      <b>Lamp settings</b><span></span><span></span>
+      <label>Lamp curve</label>
+      <select name="lampcurve">
+        <option value="0">Linear</option>
+        <option value="1">CIE lightness</option>
+        <option value="2">Gamma 2.2</option>
+        <option value="3">Custom</option>
+      </select>
+      <span></span>
+      <label>Lamp minimum</label>
+      <input type="number" min=0 max=100 step=1 onchange="checkLimits(this);" name="lampmin"></input>
+      <span>%</span>
+      <label>Lamp maximum</label>
+      <input type="number" min=0 max=100 step=1 onchange="checkLimits(this);" name="lampmax"></input>
+      <span>%</span>
+      <label>Custom curve</label>
+      <input type="text" name="lamppoints"></input>
+      <span>9 x %</span>
       <span></span>
       <input type='submit' value='Store settings'/>
       <span></span>
@@ -872,6 +893,18 @@ const char webDimmer[] = R"literal(
           if ("levellounge" in result) {
             document.getElementsByName("levellounge")[0].value = result.levellounge;
           }
+          if ("lampcurve" in result) {
+            document.getElementsByName("lampcurve")[0].value = result.lampcurve.toString();
+          }
+          if ("lampmin" in result) {
+            document.getElementsByName("lampmin")[0].value = result.lampmin;
+          }
+          if ("lampmax" in result) {
+            document.getElementsByName("lampmax")[0].value = result.lampmax;
+          }
+          if ("lamppoints" in result) {
+            document.getElementsByName("lamppoints")[0].value = result.lamppoints;
+          }
         }
       };
       xhttp.open("GET", "dimmerload", true);
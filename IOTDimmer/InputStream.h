@@ -0,0 +1,83 @@
+/*
+ * IOTDimmer - InputStream
+ * UDP stream of timestamped samples for the input effect
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef InputStream_h
+#define InputStream_h
+
+#include <WiFiUdp.h>
+
+/* Packet format (little endian):
+ * header  : 'I' 'S' channel count seq(32) stamp(32) period(16)
+ *           seq and stamp [us, sender clock] of the first sample, period [us] between samples
+ * samples : count x value(16 bit signed)
+ * Bit 7 of channel asks for an echo of every sample played out, sent to the sender address:
+ * echo    : 'I' 'E' channel 0 seq(32) hold(32), hold [us] arrival to playout
+ */
+#define STREAM_HEADER    14
+#define STREAM_PACKET    32     // maximum samples per packet
+#define STREAM_BUFFER    32     // jitter buffer samples per channel, power of two
+#define STREAM_DELAY_US  30000  // playout delay on top of the fastest transit seen
+#define STREAM_WINDOW    256    // samples per transit minimum window, tracks clock drift
+#define STREAM_ECHO      0x80   // channel flag, loopback test (tools/streamsender.py --loopback)
+#define STREAM_ECHO_SIZE 12
+#define STREAM_ECHOES    16     // echoes queued between two handle calls, power of two
+
+class CInputStream {
+public:
+  CInputStream(); // constructor
+  void connect();
+  void disconnect();
+  void handle();
+  void play();
+  unsigned long getLost();
+  unsigned long getLate();
+private:
+  struct sample {
+    unsigned long seq;
+    unsigned long stamp;     // [us] sender clock
+    unsigned long arrival;   // [us]
+    short value;
+  };
+  struct echo {
+    byte channel;
+    unsigned long seq;
+    unsigned long hold;      // [us] arrival to playout
+  };
+  struct channeldata {
+    sample buffer[STREAM_BUFFER];
+    unsigned long playSeq;   // next sample to play
+    unsigned long headSeq;   // newest sample + 1
+    unsigned long transitMin;  // [us] minimum arrival - stamp of current window
+    unsigned long transitPrev; // [us] minimum of previous window
+    unsigned short windowCount;
+    bool active;
+    bool echo;               // sender asked for echoes
+  };
+  static unsigned long getLong(const byte *data);
+  void insert(byte channel, unsigned long seq, unsigned long stamp, unsigned long arrival, short value);
+  void reset(channeldata &cd, unsigned long seq, unsigned long transit);
+  unsigned long getTransit(channeldata &cd);
+  void queueEcho(byte channel, unsigned long seq, unsigned long hold);
+  void sendEchoes();
+  WiFiUDP *udp;
+  bool connected;
+  channeldata channels[TRIAC_CHANNELS];
+  unsigned long lost;
+  unsigned long late;
+  echo echoes[STREAM_ECHOES]; // played out, sent by handle
+  byte echoHead;
+  byte echoTail;
+  IPAddress echoIP;
+  uint16_t echoPort;
+  static portMUX_TYPE mux;
+};
+
+extern CInputStream inputStream;
+
+#endif
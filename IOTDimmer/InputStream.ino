@@ -0,0 +1,226 @@
+/*
+ * IOTDimmer - InputStream
+ * UDP stream of timestamped samples for the input effect
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "InputStream.h"
+
+portMUX_TYPE CInputStream::mux = portMUX_INITIALIZER_UNLOCKED;
+
+CInputStream::CInputStream() { // constructor
+  udp = new WiFiUDP();
+  connected = false;
+  lost = 0;
+  late = 0;
+  echoHead = 0;
+  echoTail = 0;
+  echoPort = 0;
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    channels[ch].active = false;
+    channels[ch].echo = false;
+  }
+}
+
+void CInputStream::connect() {
+#if defined(STREAM_PORT)
+  udp->begin(STREAM_PORT);
+  connected = true;
+  logger.printf(LOG_WAVEFORM, "Input stream on port " + String(STREAM_PORT));
+#endif
+}
+
+void CInputStream::disconnect() {
+  if (connected) {
+    udp->stop();
+    connected = false;
+  }
+  portENTER_CRITICAL(&mux);
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    channels[ch].active = false;
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+void CInputStream::handle() { // receive, the waveform engine plays out
+  byte data[STREAM_HEADER + 2*STREAM_PACKET];
+
+  if (!connected) {
+    return;
+  }
+  while (udp->parsePacket() > 0) {
+    unsigned long arrival = micros();
+    int length = udp->read(data, sizeof(data));
+    if ((length < STREAM_HEADER) || (data[0] != 'I') || (data[1] != 'S')) {
+      continue;
+    }
+    byte channel = data[2] & ~STREAM_ECHO;
+    bool echo = (data[2] & STREAM_ECHO) != 0;
+    byte count = data[3];
+    if ((channel >= TRIAC_CHANNELS) || (count > STREAM_PACKET) || (length != STREAM_HEADER + 2*count)) {
+      continue;
+    }
+    unsigned long seq = getLong(&data[4]);
+    unsigned long stamp = getLong(&data[8]);
+    unsigned long period = (unsigned long)data[12] | ((unsigned long)data[13] << 8);
+    if (echo) {
+      echoIP = udp->remoteIP();
+      echoPort = udp->remotePort();
+    }
+    portENTER_CRITICAL(&mux);
+    channels[channel].echo = echo;
+    for (byte i = 0; i < count; i++) {
+      short value = (short)((unsigned short)data[STREAM_HEADER + 2*i] | ((unsigned short)data[STREAM_HEADER + 2*i + 1] << 8));
+      insert(channel, seq + i, stamp + i*period, arrival, value);
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+  sendEchoes();
+}
+
+void CInputStream::play() { // every half cycle from the waveform engine
+  unsigned long now = micros();
+
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    channeldata &cd = channels[ch];
+    unsigned long delay = 0;
+    short value = 0;
+    bool have = false;
+    portENTER_CRITICAL(&mux);
+    if (cd.active) {
+      unsigned long transit = getTransit(cd);
+      // one pass over at most STREAM_BUFFER slots, a missing sample is skipped once a later one is due
+      for (unsigned long seq = cd.playSeq; seq != cd.headSeq; seq++) {
+        sample &s = cd.buffer[seq & (STREAM_BUFFER-1)];
+        if (s.seq != seq) { // lost or not yet arrived
+          continue;
+        }
+        if ((long)(now - (s.stamp + transit + STREAM_DELAY_US)) < 0) {
+          break;
+        }
+        value = s.value;
+        delay = now - s.arrival;
+        have = true;
+        lost += seq - cd.playSeq;
+        cd.playSeq = seq + 1;
+        if (cd.echo) {
+          queueEcho(ch, seq, delay);
+        }
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+    if (have) {
+      diag.record(CDiag::streamdelay, delay);
+      waveforms[ch].streamInput(value);
+    }
+  }
+}
+
+unsigned long CInputStream::getLost() {
+  return lost;
+}
+
+unsigned long CInputStream::getLate() {
+  return late;
+}
+
+// Privates !!!!!!!!!!!!!
+
+unsigned long CInputStream::getLong(const byte *data) {
+  return (unsigned long)data[0] | ((unsigned long)data[1] << 8) | ((unsigned long)data[2] << 16) | ((unsigned long)data[3] << 24);
+}
+
+void CInputStream::insert(byte channel, unsigned long seq, unsigned long stamp, unsigned long arrival, short value) {
+  channeldata &cd = channels[channel];
+  unsigned long transit = arrival - stamp; // sender to local clock offset plus network delay
+
+  if ((!cd.active) || ((long)(seq - cd.playSeq) >= 4*STREAM_BUFFER) || ((long)(seq - cd.playSeq) < -4*STREAM_BUFFER)) {
+    reset(cd, seq, transit); // new or restarted sender
+  }
+  if ((long)(seq - cd.playSeq) < 0) {
+    late++;
+    return;
+  }
+  if ((seq - cd.playSeq) >= STREAM_BUFFER) { // buffer full, drop the oldest samples
+    lost += seq - cd.playSeq - STREAM_BUFFER + 1;
+    cd.playSeq = seq - STREAM_BUFFER + 1;
+  }
+  sample &s = cd.buffer[seq & (STREAM_BUFFER-1)];
+  s.seq = seq;
+  s.stamp = stamp;
+  s.arrival = arrival;
+  s.value = value;
+  if ((long)(seq - cd.headSeq) >= 0) {
+    cd.headSeq = seq + 1;
+  }
+  if ((long)(transit - cd.transitMin) < 0) {
+    cd.transitMin = transit;
+  }
+  if (++cd.windowCount >= STREAM_WINDOW) {
+    cd.transitPrev = cd.transitMin;
+    cd.transitMin = transit;
+    cd.windowCount = 0;
+  }
+}
+
+void CInputStream::reset(channeldata &cd, unsigned long seq, unsigned long transit) {
+  for (byte i = 0; i < STREAM_BUFFER; i++) {
+    cd.buffer[i].seq = seq - 1; // matches no slot ahead
+  }
+  cd.playSeq = seq;
+  cd.headSeq = seq;
+  cd.transitMin = transit;
+  cd.transitPrev = transit;
+  cd.windowCount = 0;
+  cd.active = true;
+}
+
+unsigned long CInputStream::getTransit(channeldata &cd) { // fastest transit of the last two windows
+  if ((long)(cd.transitPrev - cd.transitMin) < 0) {
+    return cd.transitPrev;
+  }
+  return cd.transitMin;
+}
+
+void CInputStream::queueEcho(byte channel, unsigned long seq, unsigned long hold) { // with mux held
+  byte next = (echoHead + 1) & (STREAM_ECHOES-1);
+  if (next == echoTail) { // full, the sender counts it as not played
+    return;
+  }
+  echoes[echoHead].channel = channel;
+  echoes[echoHead].seq = seq;
+  echoes[echoHead].hold = hold;
+  echoHead = next;
+}
+
+void CInputStream::sendEchoes() {
+  byte data[STREAM_ECHO_SIZE];
+  echo e;
+
+  while (true) {
+    portENTER_CRITICAL(&mux);
+    if (echoTail == echoHead) {
+      portEXIT_CRITICAL(&mux);
+      return;
+    }
+    e = echoes[echoTail];
+    echoTail = (echoTail + 1) & (STREAM_ECHOES-1);
+    portEXIT_CRITICAL(&mux);
+    data[0] = 'I';
+    data[1] = 'E';
+    data[2] = e.channel;
+    data[3] = 0;
+    for (byte i = 0; i < 4; i++) {
+      data[4 + i] = (byte)(e.seq >> (8*i));
+      data[8 + i] = (byte)(e.hold >> (8*i));
+    }
+    udp->beginPacket(echoIP, echoPort);
+    udp->write(data, sizeof(data));
+    udp->endPacket();
+  }
+}
+
+CInputStream inputStream;
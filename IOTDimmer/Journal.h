@@ -0,0 +1,53 @@
+/*
+ * IOTDimmer - Journal
+ * Append only, CRC protected settings log in NVS
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Journal_h
+#define Journal_h
+
+#include <Preferences.h>
+
+/* Records (little endian):
+ * header  : 'S' 'J' type version seq(32) base(32) crc(32), crc32 over header (without crc) and payload
+ * snapshot: the stored settings image in layout version, base = seq
+ * delta   : n x start(16) size(16) bytes, changes on top of snapshot base, same version
+ * Two snapshot keys alternate, so a torn snapshot keeps the previous one. Deltas are
+ * replayed in sequence and stop at the first invalid one.
+ */
+#define JOURNAL_HEADER    16
+#define JOURNAL_SNAPSHOTS 2     // alternating snapshot keys
+#define JOURNAL_DELTAS    8     // delta keys, a full log commits a snapshot
+#define JOURNAL_COMPACT   4     // deltas before compacting in the background
+#define JOURNAL_MAXSIZE   (JOURNAL_HEADER + EEPROM_SIZE + 4*SETTINGS_COUNT)
+
+class CJournal {
+public:
+  enum recordtype {rsnapshot = 0, rdelta = 1};
+  CJournal(); // constructor
+  bool load(byte *image, unsigned short &size, byte &version); // latest snapshot plus its deltas
+  bool snapshot(const byte *image, unsigned short size, byte version);
+  bool append(const byte *image, unsigned short size, const unsigned short *starts, const unsigned short *sizes, byte count);
+  bool needsCompact();
+  unsigned long getSeq();
+  byte getDeltas();
+  static uint32_t crc32(uint32_t crc, const byte *data, unsigned short length);
+private:
+  bool write(const char *key, recordtype type, byte version, byte *record, unsigned short length, uint32_t rseq, uint32_t rbase);
+  unsigned short read(const char *key, recordtype type, byte *record, uint32_t &rseq, uint32_t &rbase, byte &rversion);
+  static void putLong(byte *data, uint32_t value);
+  static uint32_t getLong(const byte *data);
+  static void snapshotKey(char *key, byte index);
+  static void deltaKey(char *key, byte index);
+  uint32_t seq;        // last written record
+  uint32_t base;       // seq of the running snapshot
+  byte slot;           // key of the running snapshot
+  byte deltas;         // deltas on top of the snapshot
+  byte layout;         // layout version of the snapshot
+};
+
+#endif
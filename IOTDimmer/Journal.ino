@@ -0,0 +1,221 @@
+/*
+ * IOTDimmer - Journal
+ * Append only, CRC protected settings log in NVS
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "Journal.h"
+
+static const char journal_ns[] = "settings";
+
+CJournal::CJournal() { // constructor
+  seq = 0;
+  base = 0;
+  slot = 0;
+  deltas = 0;
+  layout = 0;
+}
+
+bool CJournal::load(byte *image, unsigned short &size, byte &version) {
+  byte record[JOURNAL_MAXSIZE];
+  char key[4];
+  uint32_t rseq = 0;
+  uint32_t rbase = 0;
+  byte rversion = 0;
+  unsigned short capacity = size;
+  bool found = false;
+
+  for (byte s = 0; s < JOURNAL_SNAPSHOTS; s++) { // newest valid snapshot
+    snapshotKey(key, s);
+    unsigned short length = read(key, rsnapshot, record, rseq, rbase, rversion);
+    if ((length > 0) && (length <= JOURNAL_HEADER + capacity) && ((!found) || ((int32_t)(rseq - seq) > 0))) {
+      size = length - JOURNAL_HEADER;
+      memcpy(image, record + JOURNAL_HEADER, size);
+      seq = rseq;
+      base = rseq;
+      slot = s;
+      layout = rversion;
+      found = true;
+    }
+  }
+  deltas = 0;
+  if (!found) {
+    return false;
+  }
+  for (byte d = 0; d < JOURNAL_DELTAS; d++) { // replay its deltas in sequence
+    deltaKey(key, d);
+    unsigned short length = read(key, rdelta, record, rseq, rbase, rversion);
+    if ((length == 0) || (rbase != base) || (rseq != seq + 1) || (rversion != layout)) {
+      break;
+    }
+    unsigned short pos = JOURNAL_HEADER;
+    while ((pos + 4) <= length) { // check before applying anything
+      unsigned short start = record[pos] | (record[pos+1] << 8);
+      unsigned short n = record[pos+2] | (record[pos+3] << 8);
+      if (((pos + 4 + n) > length) || ((start + n) > size)) {
+        break;
+      }
+      pos += 4 + n;
+    }
+    if (pos != length) {
+      break;
+    }
+    pos = JOURNAL_HEADER;
+    while (pos < length) {
+      unsigned short start = record[pos] | (record[pos+1] << 8);
+      unsigned short n = record[pos+2] | (record[pos+3] << 8);
+      memcpy(image + start, record + pos + 4, n);
+      pos += 4 + n;
+    }
+    seq = rseq;
+    deltas++;
+  }
+  version = layout;
+  return true;
+}
+
+bool CJournal::snapshot(const byte *image, unsigned short size, byte version) {
+  byte record[JOURNAL_HEADER + EEPROM_SIZE];
+  char key[4];
+  byte next = (slot + 1) % JOURNAL_SNAPSHOTS;
+
+  if (size > EEPROM_SIZE) {
+    return false;
+  }
+  memcpy(record + JOURNAL_HEADER, image, size);
+  snapshotKey(key, next);
+  if (!write(key, rsnapshot, version, record, JOURNAL_HEADER + size, seq + 1, seq + 1)) {
+    return false;
+  }
+  seq++;
+  base = seq;
+  slot = next;
+  layout = version;
+  if (deltas > 0) { // stale now, the base no longer matches
+    Preferences prefs;
+    prefs.begin(journal_ns, false);
+    for (byte d = 0; d < deltas; d++) {
+      deltaKey(key, d);
+      prefs.remove(key);
+    }
+    prefs.end();
+  }
+  deltas = 0;
+  return true;
+}
+
+bool CJournal::append(const byte *image, unsigned short size, const unsigned short *starts, const unsigned short *sizes, byte count) {
+  byte record[JOURNAL_MAXSIZE];
+  char key[4];
+  unsigned short pos = JOURNAL_HEADER;
+
+  if ((deltas >= JOURNAL_DELTAS) || (seq == 0)) { // log full or no snapshot yet
+    return snapshot(image, size, layout);
+  }
+  for (byte i = 0; i < count; i++) {
+    if ((pos + 4 + sizes[i]) > JOURNAL_MAXSIZE) {
+      return snapshot(image, size, layout);
+    }
+    record[pos] = starts[i] & 0xFF;
+    record[pos+1] = starts[i] >> 8;
+    record[pos+2] = sizes[i] & 0xFF;
+    record[pos+3] = sizes[i] >> 8;
+    memcpy(record + pos + 4, image + starts[i], sizes[i]);
+    pos += 4 + sizes[i];
+  }
+  deltaKey(key, deltas);
+  if (!write(key, rdelta, layout, record, pos, seq + 1, base)) {
+    return false;
+  }
+  seq++;
+  deltas++;
+  return true;
+}
+
+bool CJournal::needsCompact() {
+  return deltas >= JOURNAL_COMPACT;
+}
+
+unsigned long CJournal::getSeq() {
+  return seq;
+}
+
+byte CJournal::getDeltas() {
+  return deltas;
+}
+
+uint32_t CJournal::crc32(uint32_t crc, const byte *data, unsigned short length) { // reflected 0xEDB88320, chainable
+  crc = ~crc;
+  for (unsigned short i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (byte b = 0; b < 8; b++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// Privates !!!!!!!!!!!!!
+
+bool CJournal::write(const char *key, recordtype type, byte version, byte *record, unsigned short length, uint32_t rseq, uint32_t rbase) {
+  Preferences prefs;
+  record[0] = 'S';
+  record[1] = 'J';
+  record[2] = (byte)type;
+  record[3] = version;
+  putLong(&record[4], rseq);
+  putLong(&record[8], rbase);
+  putLong(&record[12], crc32(crc32(0, record, 12), record + JOURNAL_HEADER, length - JOURNAL_HEADER));
+  prefs.begin(journal_ns, false);
+  bool done = (prefs.putBytes(key, record, length) == length);
+  prefs.end();
+  return done;
+}
+
+unsigned short CJournal::read(const char *key, recordtype type, byte *record, uint32_t &rseq, uint32_t &rbase, byte &rversion) {
+  Preferences prefs;
+  unsigned short length = 0;
+
+  prefs.begin(journal_ns, true);
+  size_t stored = prefs.getBytesLength(key);
+  if ((stored > JOURNAL_HEADER) && (stored <= JOURNAL_MAXSIZE)) {
+    length = prefs.getBytes(key, record, JOURNAL_MAXSIZE);
+  }
+  prefs.end();
+  if ((length <= JOURNAL_HEADER) || (record[0] != 'S') || (record[1] != 'J') || (record[2] != (byte)type)) {
+    return 0;
+  }
+  if (getLong(&record[12]) != crc32(crc32(0, record, 12), record + JOURNAL_HEADER, length - JOURNAL_HEADER)) {
+    return 0;
+  }
+  rseq = getLong(&record[4]);
+  rbase = getLong(&record[8]);
+  rversion = record[3];
+  return length;
+}
+
+void CJournal::putLong(byte *data, uint32_t value) {
+  data[0] = value & 0xFF;
+  data[1] = (value >> 8) & 0xFF;
+  data[2] = (value >> 16) & 0xFF;
+  data[3] = (value >> 24) & 0xFF;
+}
+
+uint32_t CJournal::getLong(const byte *data) {
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+void CJournal::snapshotKey(char *key, byte index) {
+  key[0] = 's';
+  key[1] = '0' + index;
+  key[2] = '\0';
+}
+
+void CJournal::deltaKey(char *key, byte index) {
+  key[0] = 'd';
+  key[1] = '0' + index;
+  key[2] = '\0';
+}
@@ -23,6 +23,7 @@ public:
   void AddItem(String tag, float item);
   void AddItem(String tag, boolean item);
   void AddArray(String tag, String item[], int n);
+  void AddArray(String tag, unsigned long item[], int n);
   void Clear();
 private:
   void AddToJsonString(String result);
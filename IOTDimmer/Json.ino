@@ -103,6 +103,26 @@ void JSON::AddArray(String tag, String item[], int n) {
   AddToJsonString(result);
 }
 
+void JSON::AddArray(String tag, unsigned long item[], int n) {
+  String result = "";
+  if (tag.length() == 0) {
+    arrayOnly = true;
+  } else if (arrayOnly) {
+    return;
+  } else {
+    result = "\"" + tag + "\":";
+  }
+  result += "[";
+  for(int i = 0; i < n; i++) {
+    if (i > 0) {
+      result += ",";
+    }
+    result += String(item[i]);
+  }
+  result += "]";
+  AddToJsonString(result);
+}
+
 void JSON::Clear() {
   JsonString = "";
   arrayOnly = false;
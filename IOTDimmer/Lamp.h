@@ -0,0 +1,51 @@
+/*
+ * IOTDimmer - Lamp
+ * Perceptual brightness curves and per lamp calibration
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Lamp_h
+#define Lamp_h
+
+// compile time curves for the tables, relative output [0..1] for level [0..100] %
+constexpr double lampCube(double x) {
+  return x*x*x;
+}
+constexpr double lampCie(double l) { // CIE 1931 lightness L* to luminance
+  return (l <= 8.0) ? l/903.3 : lampCube((l + 16.0)/116.0);
+}
+constexpr double lampRoot5(double x, double r, int n) { // Newton iteration from above
+  return (n == 0) ? r : lampRoot5(x, (4.0*r + x/(r*r*r*r))/5.0, n - 1);
+}
+constexpr double lampGamma(double x) { // x^2.2 = x^2 * x^(1/5)
+  return (x <= 0.0) ? 0.0 : x*x*lampRoot5(x, 1.0, 40);
+}
+constexpr unsigned short lampCieQ15(int level) {
+  return (unsigned short)(lampCie(level)*CURVE_ONE + 0.5);
+}
+constexpr unsigned short lampGammaQ15(int level) {
+  return (unsigned short)(lampGamma(level/100.0)*CURVE_ONE + 0.5);
+}
+
+class CLamp {
+public:
+  enum lampcurve {llinear = 0, lcie = 1, lgamma = 2, lcustom = 3};
+  CLamp(); // constructor
+  void init();
+  void update();
+  long getOutput(byte level); // [Q15] relative output of the lamp for level [%]
+  String getPoints();
+  static bool setPoints(String points, byte *values);
+private:
+  lampcurve curve;
+  byte levelMin;              // [%] output at the lowest level
+  byte levelMax;              // [%] output at the highest dimmed level
+  byte points[LAMP_POINTS];   // [%] custom curve, made monotonic
+};
+
+extern CLamp lamp;
+
+#endif
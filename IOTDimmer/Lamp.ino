@@ -0,0 +1,108 @@
+/*
+ * IOTDimmer - Lamp
+ * Perceptual brightness curves and per lamp calibration
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "Lamp.h"
+
+#define LAMP_10(f, i) f(i), f(i+1), f(i+2), f(i+3), f(i+4), f(i+5), f(i+6), f(i+7), f(i+8), f(i+9)
+#define LAMP_TABLE(f) {LAMP_10(f, 0), LAMP_10(f, 10), LAMP_10(f, 20), LAMP_10(f, 30), LAMP_10(f, 40), \
+                       LAMP_10(f, 50), LAMP_10(f, 60), LAMP_10(f, 70), LAMP_10(f, 80), LAMP_10(f, 90), f(100)}
+
+// generated by the compiler, one entry per percent
+const unsigned short lampCieTable[PWR_ON+1] = LAMP_TABLE(lampCieQ15);
+const unsigned short lampGammaTable[PWR_ON+1] = LAMP_TABLE(lampGammaQ15);
+
+static_assert(lampCieQ15(PWR_ON) == CURVE_ONE, "CIE table must end at 1.0");
+static_assert(lampGammaQ15(PWR_ON) == CURVE_ONE, "Gamma table must end at 1.0");
+
+CLamp::CLamp() { // constructor
+  curve = llinear;
+  levelMin = PWR_OFF;
+  levelMax = PWR_ON;
+  for (byte i = 0; i < LAMP_POINTS; i++) {
+    points[i] = (byte)((i*PWR_ON)/(LAMP_POINTS-1));
+  }
+}
+
+void CLamp::init() {
+  byte value = 0;
+  curve = (lampcurve)settings.getByte(settings.LampCurve);
+  if (curve > lcustom) {
+    curve = llinear;
+  }
+  levelMin = min(settings.getByte(settings.LampMin), (byte)PWR_ON);
+  levelMax = min(settings.getByte(settings.LampMax), (byte)PWR_ON);
+  if (levelMax < levelMin) {
+    levelMax = levelMin;
+  }
+  settings.get(settings.LampPoints, (char *)points);
+  for (byte i = 0; i < LAMP_POINTS; i++) { // the ignition table must be monotonic
+    value = max(value, min(points[i], (byte)PWR_ON));
+    points[i] = value;
+  }
+}
+
+void CLamp::update() { // settings changed
+  init();
+  triac.setCalibration();
+}
+
+long CLamp::getOutput(byte level) {
+  long output = 0;
+
+  if (level == PWR_OFF) {
+    return 0;
+  }
+  if (level >= PWR_ON) {
+    return CURVE_ONE;
+  }
+  switch (curve) {
+    case lcie:
+      output = lampCieTable[level];
+      break;
+    case lgamma:
+      output = lampGammaTable[level];
+      break;
+    case lcustom: {
+      unsigned short pos = (unsigned short)level*(LAMP_POINTS-1);
+      byte i = pos/PWR_ON;
+      long frac = pos%PWR_ON;
+      output = (((long)points[i]*PWR_ON + ((long)points[i+1] - points[i])*frac)*CURVE_ONE)/(PWR_ON*PWR_ON);
+      break;
+    }
+    default:
+      output = ((long)level*CURVE_ONE)/PWR_ON;
+  }
+  return ((long)levelMin*CURVE_ONE + ((long)levelMax - levelMin)*output)/PWR_ON;
+}
+
+String CLamp::getPoints() {
+  String str = "";
+  for (byte i = 0; i < LAMP_POINTS; i++) {
+    if (i > 0) {
+      str += ",";
+    }
+    str += String(points[i]);
+  }
+  return str;
+}
+
+bool CLamp::setPoints(String str, byte *values) { // comma separated [%]
+  int start = 0;
+  for (byte i = 0; i < LAMP_POINTS; i++) {
+    int end = str.indexOf(',', start);
+    if ((end < 0) && (i < LAMP_POINTS - 1)) {
+      return false;
+    }
+    values[i] = (byte)constrain(str.substring(start, (end < 0) ? str.length() : end).toInt(), PWR_OFF, PWR_ON);
+    start = end + 1;
+  }
+  return true;
+}
+
+CLamp lamp;
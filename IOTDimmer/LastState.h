@@ -0,0 +1,65 @@
+/*
+ * IOTDimmer - LastState
+ * Last level, mode and effect, restored after a restart or power loss
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef LastState_h
+#define LastState_h
+
+#include <Preferences.h>
+
+/* Every change is kept in RTC memory, which survives a restart or brownout reset.
+ * Flash (nvs) covers a power loss: a state is written after it has been stable for
+ * LASTSTATE_STABLE_MS, at most once per LASTSTATE_FLASH_MS, rotating over
+ * LASTSTATE_SLOTS keys. Both copies are CRC protected, the newest valid one is restored
+ * as soon as the zero crossing is calibrated, before the network is up.
+ */
+#define LASTSTATE_MAGIC     0x4C535431UL // "LST1"
+#define LASTSTATE_SLOTS     4
+#define LASTSTATE_STABLE_MS 5000    // no flash writes while dimming or fading
+#define LASTSTATE_FLASH_MS  60000   // minimum time between flash writes
+
+const char laststate_ns[] = "laststate"; // nvs namespace
+
+class CLastState {
+public:
+  CLastState(); // constructor
+  void init();
+  void handle();
+private:
+  struct channelstate {
+    unsigned short level;    // [LEVEL_ON] requested level, without effects
+    byte mode;               // CWaveform::waveformmode
+    byte effect;             // CWaveform::waveformeffect
+  };
+  struct staterecord {
+    uint32_t magic;
+    uint32_t seq;
+    channelstate channel[TRIAC_CHANNELS];
+    uint32_t crc;
+  };
+  void restore();
+  void capture(staterecord &record);
+  bool equal(const staterecord &a, const staterecord &b);
+  void writeFlash();
+  bool loadFlash(staterecord &record);
+  static bool valid(const staterecord &record);
+  static uint32_t checksum(const staterecord &record);
+  static void slotKey(char *key, byte index);
+  static staterecord rtc;
+  staterecord state;         // last captured, mirrored in RTC memory
+  staterecord flash;         // last written to flash
+  byte slot;                 // key of the last flash record
+  bool restored;
+  bool pending;              // state differs from flash
+  unsigned long changed;     // [ms] last change of state
+  unsigned long written;     // [ms] last flash write
+};
+
+extern CLastState lastState;
+
+#endif
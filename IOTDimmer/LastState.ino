@@ -0,0 +1,159 @@
+/*
+ * IOTDimmer - LastState
+ * Last level, mode and effect, restored after a restart or power loss
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "LastState.h"
+#include "Journal.h"
+
+RTC_NOINIT_ATTR CLastState::staterecord CLastState::rtc; // kept over a restart, garbage after power on
+
+CLastState::CLastState() { // constructor
+  memset(&state, 0, sizeof(state));
+  memset(&flash, 0, sizeof(flash));
+  slot = LASTSTATE_SLOTS - 1;
+  restored = false;
+  pending = false;
+  changed = 0;
+  written = 0;
+}
+
+void CLastState::init() { // after the waveforms, mode and effect are restored right away
+  bool found = loadFlash(flash);
+
+  if (valid(rtc)) {
+    state = rtc;
+    logger.printf("LastState: Found in RTC memory");
+  } else if (found) {
+    state = flash;
+    logger.printf("LastState: Found in flash, record " + String(flash.seq));
+  } else {
+    capture(state);
+  }
+  state.seq = flash.seq;
+  restored = !(valid(rtc) || found);
+  if (!restored) {
+    for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+      if (state.channel[ch].mode <= (byte)CWaveform::qsine) {
+        waveforms[ch].setMode(state.channel[ch].mode);
+      }
+      if (state.channel[ch].effect <= (byte)CWaveform::ecandle) {
+        waveforms[ch].setEffect(state.channel[ch].effect);
+      }
+    }
+  }
+  pending = !equal(state, flash); // restarted before the flash write
+  changed = millis();
+  written = millis() - LASTSTATE_FLASH_MS; // the first write only waits for a stable state
+}
+
+void CLastState::handle() {
+  staterecord now;
+
+  if (!restored) { // nothing is saved before the previous state is back
+    if (!triac.getCalibrated()) {
+      return;
+    }
+    restore();
+  }
+  capture(now);
+  if (!equal(now, state)) {
+    now.seq = state.seq;
+    state = now;
+    rtc = state;
+    rtc.crc = checksum(rtc);
+    changed = millis();
+    pending = !equal(state, flash);
+  }
+  if ((pending) && ((millis() - changed) >= LASTSTATE_STABLE_MS) && ((millis() - written) >= LASTSTATE_FLASH_MS)) {
+    writeFlash();
+  }
+}
+
+// Privates !!!!!!!!!!!!!
+
+void CLastState::restore() {
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    if (!waveforms[ch].getCommanded()) { // not if a command was quicker, an explicit off included
+      waveforms[ch].setLevel(state.channel[ch].level);
+    }
+  }
+  restored = true;
+  logger.printf("LastState: Restored");
+}
+
+void CLastState::capture(staterecord &record) {
+  record.magic = LASTSTATE_MAGIC;
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    if (!waveforms[ch].getScene()) { // a running scene keeps the level it started from
+      record.channel[ch].level = waveforms[ch].getLevel();
+    } else {
+      record.channel[ch].level = state.channel[ch].level;
+    }
+    record.channel[ch].mode = waveforms[ch].getMode();
+    record.channel[ch].effect = waveforms[ch].getEffect();
+  }
+}
+
+bool CLastState::equal(const staterecord &a, const staterecord &b) {
+  return memcmp(a.channel, b.channel, sizeof(a.channel)) == 0;
+}
+
+void CLastState::writeFlash() {
+  Preferences prefs;
+  char key[4];
+
+  flash = state;
+  flash.seq = state.seq + 1;
+  flash.crc = checksum(flash);
+  slot = (slot + 1) % LASTSTATE_SLOTS; // spread the writes
+  slotKey(key, slot);
+  prefs.begin(laststate_ns, false);
+  if (prefs.putBytes(key, &flash, sizeof(flash)) != sizeof(flash)) {
+    logger.printf("LastState: Flash write failed");
+  }
+  prefs.end();
+  state.seq = flash.seq;
+  pending = false;
+  written = millis();
+}
+
+bool CLastState::loadFlash(staterecord &record) { // newest valid slot
+  Preferences prefs;
+  staterecord rd;
+  char key[4];
+  bool found = false;
+
+  prefs.begin(laststate_ns, true);
+  for (byte s = 0; s < LASTSTATE_SLOTS; s++) {
+    slotKey(key, s);
+    if ((prefs.getBytesLength(key) == sizeof(rd)) && (prefs.getBytes(key, &rd, sizeof(rd)) == sizeof(rd)) &&
+        (valid(rd)) && ((!found) || ((int32_t)(rd.seq - record.seq) > 0))) {
+      record = rd;
+      slot = s;
+      found = true;
+    }
+  }
+  prefs.end();
+  return found;
+}
+
+bool CLastState::valid(const staterecord &record) {
+  return (record.magic == LASTSTATE_MAGIC) && (record.crc == checksum(record));
+}
+
+uint32_t CLastState::checksum(const staterecord &record) {
+  return CJournal::crc32(0, (const byte *)&record, offsetof(staterecord, crc));
+}
+
+void CLastState::slotKey(char *key, byte index) {
+  key[0] = 'l';
+  key[1] = '0' + index;
+  key[2] = '\0';
+}
+
+CLastState lastState;
@@ -0,0 +1,35 @@
+/*
+ * IOTDimmer - Noise
+ * Seeded pseudo random numbers and smooth noise for effects
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Noise_h
+#define Noise_h
+
+#define NOISE_ONE     65536ULL // noise position of one lattice step
+#define NOISE_OCTAVES 3        // candle noise octaves, each at double rate and half amplitude
+
+/* Everything is a pure function of the seed (and position) in 32 bit (uint32_t)
+ * arithmetic, so a sequence can be reproduced and checked off target:
+ *   CNoise rng(1234); rng.next() ...  -> xorshift32 sequence
+ *   CNoise::value(1234, pos)          -> value noise, pos in [NOISE_ONE] lattice steps
+ */
+class CNoise {
+public:
+  CNoise(uint32_t iseed = 1); // constructor
+  void seed(uint32_t iseed);
+  uint32_t next();                  // xorshift32, never 0
+  long range(long low, long high);  // [low..high)
+  static uint32_t hash(uint32_t iseed, uint32_t n); // random access random numbers
+  static long value(uint32_t iseed, unsigned long long pos);  // [-CURVE_ONE..CURVE_ONE] smoothstep interpolated
+  static long candle(uint32_t iseed, unsigned long long pos); // [-CURVE_ONE..CURVE_ONE] fractal value noise
+private:
+  static long lattice(uint32_t iseed, uint32_t n);
+  uint32_t state;
+};
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * IOTDimmer - Noise
+ * Seeded pseudo random numbers and smooth noise for effects
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "Noise.h"
+
+CNoise::CNoise(uint32_t iseed) { // constructor
+  seed(iseed);
+}
+
+void CNoise::seed(uint32_t iseed) {
+  state = hash(iseed, 0);
+  if (state == 0) { // xorshift sticks at 0
+    state = 0x9E3779B9UL;
+  }
+}
+
+uint32_t CNoise::next() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+long CNoise::range(long low, long high) {
+  if (high <= low) {
+    return low;
+  }
+  return low + (long)(((unsigned long long)next()*(uint32_t)(high - low)) >> 32);
+}
+
+uint32_t CNoise::hash(uint32_t iseed, uint32_t n) { // lowbias32 finalizer
+  uint32_t x = iseed ^ (n*0x9E3779B9UL);
+  x ^= x >> 16;
+  x *= 0x7FEB352DUL;
+  x ^= x >> 15;
+  x *= 0x846CA68BUL;
+  x ^= x >> 16;
+  return x;
+}
+
+long CNoise::value(uint32_t iseed, unsigned long long pos) {
+  uint32_t n = (uint32_t)(pos/NOISE_ONE);
+  uint32_t f = (uint32_t)(pos%NOISE_ONE) >> (16 - CURVE_SHIFT); // Q15
+  uint32_t t = (((f*f) >> CURVE_SHIFT)*((uint32_t)(3*CURVE_ONE) - 2*f)) >> CURVE_SHIFT; // smoothstep, no kinks at the lattice
+  long a = lattice(iseed, n);
+  long b = lattice(iseed, n + 1);
+  return a + (long)(((long long)(b - a)*t) >> CURVE_SHIFT);
+}
+
+long CNoise::candle(uint32_t iseed, unsigned long long pos) {
+  long sum = 0;
+  long weight = 1L << (NOISE_OCTAVES - 1);
+  long total = 0;
+  for (byte o = 0; o < NOISE_OCTAVES; o++) {
+    sum += weight*value(hash(iseed, o + 1), pos << o);
+    total += weight;
+    weight >>= 1;
+  }
+  return sum/total;
+}
+
+// Privates !!!!!!!!!!!!!
+
+long CNoise::lattice(uint32_t iseed, uint32_t n) { // [-CURVE_ONE..CURVE_ONE]
+  return (long)(hash(iseed, n) >> 16) - CURVE_ONE;
+}
@@ -0,0 +1,63 @@
+/*
+ * IOTDimmer - Scene
+ * Keyframe light timelines, played by the waveform engine
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Scene_h
+#define Scene_h
+
+#include <Preferences.h>
+#include "Json.h"
+
+/* Binary scene format (little endian):
+ * header  : 'S' 'C' version flags count
+ * segment : duration(16 bit) level[%] curve
+ *           curve bits 0..3 = waveformmode [0..3] (instant ends the segment at level)
+ *           curve bits 4..5 = duration unit 0 = 10 ms, 1 = 100 ms, 2 = 1 s
+ */
+#define SCENE_SEGMENTS 64
+#define SCENE_HEADER   5
+#define SCENE_SEGSIZE  4
+#define SCENE_MAXSIZE  (SCENE_HEADER + SCENE_SEGMENTS*SCENE_SEGSIZE)
+#define SCENE_VERSION  1
+#define SCENE_LOOP     0x01   // flags: restart after the last segment
+#define SCENE_CURVE    0x0F
+#define SCENE_UNIT     4      // shift of duration unit in curve byte
+
+const char scene_ns[] = "scene"; // nvs namespace
+const char scene_key[] = "data";
+
+class CScene {
+public:
+  struct segment {
+    unsigned long duration; // [ms]
+    byte level;             // [%]
+    byte curve;             // CWaveform::waveformmode
+  };
+  CScene(); // constructor
+  void init();
+  bool load(const byte *data, unsigned int length);
+  bool loadHex(String hex);
+  String getHex();
+  String getJson();
+  byte getCount();
+  bool getLoop();
+  void getSegment(byte index, segment &seg);
+private:
+  bool parse(const byte *data, unsigned int length, segment *segs, byte &nr, bool &lp);
+  void store();
+  byte raw[SCENE_MAXSIZE];          // as uploaded, stored in flash
+  unsigned short rawLength;
+  segment segments[SCENE_SEGMENTS]; // decoded once, the engine only indexes
+  byte count;
+  bool loop;
+  static portMUX_TYPE mux;
+};
+
+extern CScene scene;
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * IOTDimmer - Scene
+ * Keyframe light timelines, played by the waveform engine
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "Scene.h"
+
+portMUX_TYPE CScene::mux = portMUX_INITIALIZER_UNLOCKED;
+
+const unsigned long scene_units[] = {10, 100, 1000}; // [ms] per duration unit
+
+CScene::CScene() { // constructor
+  rawLength = 0;
+  count = 0;
+  loop = false;
+}
+
+void CScene::init() {
+  Preferences prefs;
+  byte data[SCENE_MAXSIZE];
+  size_t length = 0;
+
+  prefs.begin(scene_ns, true);
+  length = prefs.getBytesLength(scene_key);
+  if ((length > 0) && (length <= SCENE_MAXSIZE)) {
+    length = prefs.getBytes(scene_key, data, SCENE_MAXSIZE);
+  } else {
+    length = 0;
+  }
+  prefs.end();
+  if (length > 0) {
+    memcpy(raw, data, length); // already in flash
+    rawLength = length;
+    if (load(data, length)) {
+      logger.printf(LOG_WAVEFORM, "Scene loaded: " + String(count) + " segments");
+    }
+  }
+}
+
+bool CScene::load(const byte *data, unsigned int length) {
+  segment segs[SCENE_SEGMENTS];
+  byte nr = 0;
+  bool lp = false;
+
+  if (!parse(data, length, segs, nr, lp)) {
+    logger.printf(LOG_WAVEFORM, "Scene invalid, length: " + String(length));
+    return false;
+  }
+  if ((length != rawLength) || (memcmp(data, raw, length) != 0)) {
+    memcpy(raw, data, length);
+    rawLength = length;
+    store();
+  }
+  portENTER_CRITICAL(&mux);
+  memcpy(segments, segs, nr*sizeof(segment));
+  count = nr;
+  loop = lp;
+  portEXIT_CRITICAL(&mux);
+  return true;
+}
+
+bool CScene::loadHex(String hex) {
+  byte data[SCENE_MAXSIZE];
+  unsigned int length = hex.length()/2;
+
+  if ((hex.length() % 2) || (length > SCENE_MAXSIZE)) {
+    return false;
+  }
+  for (unsigned int i = 0; i < length; i++) {
+    char *end = NULL;
+    char digits[3] = {hex[2*i], hex[2*i+1], 0};
+    data[i] = (byte)strtoul(digits, &end, 16);
+    if (*end != 0) {
+      return false;
+    }
+  }
+  return load(data, length);
+}
+
+String CScene::getHex() {
+  const char digits[] = "0123456789abcdef";
+  String hex = "";
+  for (unsigned short i = 0; i < rawLength; i++) {
+    hex.concat(digits[raw[i] >> 4]);
+    hex.concat(digits[raw[i] & 0x0F]);
+  }
+  return hex;
+}
+
+String CScene::getJson() {
+  JSON jString;
+  jString.AddItem("segments", (int)getCount());
+  jString.AddItem("loop", getLoop());
+  jString.AddItem("data", getHex());
+  return jString.GetJson();
+}
+
+byte CScene::getCount() {
+  return count;
+}
+
+bool CScene::getLoop() {
+  return loop;
+}
+
+void CScene::getSegment(byte index, segment &seg) {
+  portENTER_CRITICAL(&mux);
+  if (index < count) {
+    seg = segments[index];
+  } else {
+    seg = {0, PWR_OFF, 0};
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+// Privates !!!!!!!!!!!!!
+
+bool CScene::parse(const byte *data, unsigned int length, segment *segs, byte &nr, bool &lp) {
+  if ((length < SCENE_HEADER) || (data[0] != 'S') || (data[1] != 'C') || (data[2] != SCENE_VERSION)) {
+    return false;
+  }
+  nr = data[4];
+  if ((nr > SCENE_SEGMENTS) || (length != SCENE_HEADER + (unsigned int)nr*SCENE_SEGSIZE)) {
+    return false;
+  }
+  lp = (data[3] & SCENE_LOOP);
+  for (byte i = 0; i < nr; i++) {
+    const byte *s = &data[SCENE_HEADER + i*SCENE_SEGSIZE];
+    byte unit = s[3] >> SCENE_UNIT;
+    segs[i].curve = s[3] & SCENE_CURVE;
+    segs[i].level = s[2];
+    if ((unit >= NUMITEMS(scene_units)) || (segs[i].curve > (byte)CWaveform::qsine) || (segs[i].level > PWR_ON)) {
+      return false;
+    }
+    segs[i].duration = ((unsigned long)s[0] | ((unsigned long)s[1] << 8)) * scene_units[unit];
+  }
+  return true;
+}
+
+void CScene::store() {
+  Preferences prefs;
+  prefs.begin(scene_ns, false);
+  prefs.putBytes(scene_key, raw, rawLength);
+  prefs.end();
+  logger.printf(LOG_WAVEFORM, "Scene stored: " + String(rawLength) + " bytes");
+}
+
+CScene scene;
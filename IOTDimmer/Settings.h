@@ -1,6 +1,6 @@
 /* 
  * IOTDimmer - Settings
- * Reads and writes settings from EEPROM
+ * Settings in RAM, stored in a journal
  * Hardware: Lolin S2 Mini
  * Version 0.80
  * 14-5-2021
@@ -12,11 +12,13 @@
 
 #include <EEPROM.h>
 #include "mbedtls/aes.h"
+#include "Journal.h"
 
 #define EEPROM_SIZE   512
 #define EEPROM_START  0
 #define STANDARD_SIZE 32
 #define PASSWORD_SIZE 64
+#define LAMP_POINTS   9       // custom lamp curve points at 0, 12.5 .. 100 % level
 
 #define DT_BYTE   0
 #define DT_SHORT  1
@@ -28,15 +30,112 @@
 #define IV_LEN    16
 #define KEY_BITS  256
 
+#define SETTINGS_COMMIT_MS 2000 // saves within this window are coalesced into one journal record
+#define SETTINGS_VERSION   1    // stored layout, 0 is the EEPROM layout of earlier versions
+
 //#define DO_ENCRYPT // This can mess up settings
 
-class Item {
+/* Settings schema: name, datatype, size [byte] stored, default, min, max (no range check if min == max),
+ * layout version the setting was added in.
+ * The stored layout follows this order, the RAM mirror (settingsdata) and the Item table are generated from it.
+ * To add a setting: add it anywhere with since = SETTINGS_VERSION + 1 and bump SETTINGS_VERSION, stored
+ * settings are migrated at boot (see cSettings::migrate). Never remove or reorder entries of a released layout.
+ */
+#define SETTINGS_SCHEMA(X) \
+  /* Waveform parameters */ \
+  X(WaveMode,            DT_BYTE,   1,             DEF_MODE,          0, 3,   0) \
+  X(WaveMode100Percent,  DT_SHORT,  2,             DEF_MODE100,       0, 0,   0) /* [ms] */ \
+  X(WaveEffect,          DT_BYTE,   1,             DEF_EFFECT,        0, 5,   0) \
+  X(WaveEffectMagnitude, DT_BYTE,   1,             DEF_EFFECT_MAG,    0, 100, 0) /* [%] */ \
+  X(WaveEffectGain,      DT_FLOAT,  4,             DEF_EFFECT_GAIN,   0, 0,   0) /* [%/int] */ \
+  X(WaveEffectTime,      DT_SHORT,  2,             DEF_EFFECT_TIME,   0, 0,   0) /* [ms] */ \
+  /* Triac parameters */ \
+  X(TriacMode,           DT_BYTE,   1,             DEF_TRIAC_MODE,    0, 2,   0) \
+  X(LevelOff,            DT_BYTE,   1,             DEF_LEVEL_OFF,     0, 100, 0) /* [%] */ \
+  X(LevelOn,             DT_BYTE,   1,             DEF_LEVEL_ON,      0, 100, 0) /* [%] */ \
+  X(LevelLounge,         DT_BYTE,   1,             DEF_LEVEL_LOUNGE,  0, 100, 0) /* [%] */ \
+  /* Wifi parameters */ \
+  X(ssid,                DT_CYPHER, STANDARD_SIZE, DEF_SSID,          0, 0,   0) \
+  X(password,            DT_CYPHER, PASSWORD_SIZE, DEF_PASSWORD,      0, 0,   0) \
+  X(hostname,            DT_STRING, STANDARD_SIZE, DEF_HOSTNAME,      0, 0,   0) \
+  X(NtpServer,           DT_STRING, STANDARD_SIZE, DEF_NTPSERVER,     0, 0,   0) \
+  X(NtpZone,             DT_BYTE,   1,             DEF_NTPZONE,       0, 0,   0) /* [-12..12] as signed char */ \
+  X(UseDST,              DT_BYTE,   1,             DEF_USEDST,        0, 1,   0) \
+  X(UdpPort,             DT_SHORT,  2,             DEF_LOGPORT,       0, 0,   0) \
+  X(UdpEnabled,          DT_BYTE,   1,             DEF_LOGENABLE,     0, 1,   0) \
+  X(UpdDebugLevel,       DT_SHORT,  2,             DEF_LOGDEBUG,      0, 0,   0) \
+  /* MQTT parameters */ \
+  X(brokerAddress,       DT_STRING, STANDARD_SIZE, DEF_BROKERADDRESS, 0, 0,   0) \
+  X(mqttPort,            DT_SHORT,  2,             DEF_MQTTPORT,      0, 0,   0) \
+  X(mqttUsername,        DT_CYPHER, STANDARD_SIZE, DEF_MQTTUSERNAME,  0, 0,   0) \
+  X(mqttPassword,        DT_CYPHER, PASSWORD_SIZE, DEF_MQTTPASSWORD,  0, 0,   0) \
+  X(mainTopic,           DT_STRING, PASSWORD_SIZE, DEF_MAINTOPIC,     0, 0,   0) \
+  X(mqttQos,             DT_BYTE,   1,             DEF_MQTTQOS,       0, 1,   0) \
+  X(mqttRetain,          DT_BYTE,   1,             DEF_MQTTRETAIN,    0, 1,   0) \
+  X(UseMqtt,             DT_BYTE,   1,             DEF_USEMQTT,       0, 1,   0) \
+  X(haDisco,             DT_BYTE,   1,             DEF_HADISCO,       0, 1,   0) \
+  X(haTopic,             DT_STRING, STANDARD_SIZE, DEF_HATOPIC,       0, 0,   0) \
+  X(haSpare,             DT_STRING, STANDARD_SIZE, "",                0, 0,   0) /* unused, haTopic took PASSWORD_SIZE */ \
+  /* Lamp parameters */ \
+  X(LampCurve,           DT_BYTE,   1,             DEF_LAMP_CURVE,    0, 3,   0) \
+  X(LampMin,             DT_BYTE,   1,             DEF_LAMP_MIN,      0, 100, 0) /* [%] */ \
+  X(LampMax,             DT_BYTE,   1,             DEF_LAMP_MAX,      0, 100, 0) /* [%] */ \
+  X(LampPoints,          DT_STRING, LAMP_POINTS,   DEF_LAMP_POINTS,   0, 0,   0) /* [%] raw bytes */
+
+// RAM type of a datatype, strings are terminated and cyphers are held decrypted
+template<byte datatype, unsigned short size> struct settingtype { typedef byte type; };
+template<unsigned short size> struct settingtype<DT_SHORT, size> { typedef unsigned short type; };
+template<unsigned short size> struct settingtype<DT_LONG, size> { typedef unsigned long type; };
+template<unsigned short size> struct settingtype<DT_FLOAT, size> { typedef float type; };
+template<unsigned short size> struct settingtype<DT_STRING, size> { typedef char type[size + 1]; };
+template<unsigned short size> struct settingtype<DT_CYPHER, size> { typedef char type[size + 1]; };
+
+struct settingsdata { // RAM mirror, read with settings.data().<name>
+#define SETTINGS_FIELD(name, datatype, size, def, lo, hi, since) settingtype<datatype, size>::type name;
+  SETTINGS_SCHEMA(SETTINGS_FIELD)
+#undef SETTINGS_FIELD
+};
+
+enum settingid {
+#define SETTINGS_ID(name, datatype, size, def, lo, hi, since) sid_##name,
+  SETTINGS_SCHEMA(SETTINGS_ID)
+#undef SETTINGS_ID
+  SETTINGS_COUNT
+};
+
+constexpr unsigned short settingSizes[SETTINGS_COUNT] = {
+#define SETTINGS_SIZE(name, datatype, size, def, lo, hi, since) size,
+  SETTINGS_SCHEMA(SETTINGS_SIZE)
+#undef SETTINGS_SIZE
+};
+
+constexpr byte settingSince[SETTINGS_COUNT] = {
+#define SETTINGS_SINCE(name, datatype, size, def, lo, hi, since) since,
+  SETTINGS_SCHEMA(SETTINGS_SINCE)
+#undef SETTINGS_SINCE
+};
+
+constexpr unsigned short settingStart(int id) { // address in the current layout, chained at compile time
+  return (id == 0) ? EEPROM_START : settingStart(id - 1) + settingSizes[id - 1];
+}
+
+constexpr bool settingSinceValid(int id) { // no setting from a layout newer than SETTINGS_VERSION
+  return (id == SETTINGS_COUNT) || ((settingSince[id] <= SETTINGS_VERSION) && settingSinceValid(id + 1));
+}
+
+static_assert(settingStart(SETTINGS_COUNT) <= EEPROM_SIZE, "Settings do not fit in EEPROM");
+static_assert(settingSinceValid(0), "Setting added in a layout newer than SETTINGS_VERSION");
+static_assert(SETTINGS_COUNT <= 64, "Dirty mask holds 64 settings");
+
+class Item { // schema entry
   public:
-    Item(byte _datatype, unsigned short _start); // constructor
-    Item(byte _datatype, unsigned short _start, unsigned short _size); // constructor
     byte datatype;
-    unsigned short start;
-    unsigned short size;
+    unsigned short start;      // EEPROM address
+    unsigned short size;       // EEPROM bytes
+    unsigned short offset;     // in settingsdata
+    long min;
+    long max;
+    byte since;                // layout version it was added in
 };
 
 class cSettings {
@@ -44,79 +143,79 @@ class cSettings {
     cSettings(); // constructor
     ~cSettings(); // destructor
     void init();
-    void get(Item *item, byte &b);
-    void get(Item *item, unsigned short &s);
-    void get(Item *item, unsigned long &l);
-    void get(Item *item, float &f);
-    void get(Item *item, String &s);
-    void get(Item *item, char *s);
-    byte getByte(Item *item);
-    unsigned short getShort(Item *item);
-    unsigned long getLong(Item *item);
-    float getFloat(Item *item);
-    String getString(Item *item);
-    String getDecrypt(Item *item);
-
-    void set(Item *item, byte &b);
-    void set(Item *item, unsigned short &s);
-    void set(Item *item, unsigned long &l);
-    void set(Item *item, float &f);
-    void set(Item *item, String &s);
-    void set(Item *item, char *s);
-    void setEncrypt(Item *item, String &s);
-
-    void update();
+    void handle();
+    inline const settingsdata &data() { // typed access to the RAM mirror
+      return ram;
+    }
+    void get(const Item *item, byte &b);
+    void get(const Item *item, unsigned short &s);
+    void get(const Item *item, unsigned long &l);
+    void get(const Item *item, float &f);
+    void get(const Item *item, String &s);
+    void get(const Item *item, char *s);
+    byte getByte(const Item *item);
+    unsigned short getShort(const Item *item);
+    unsigned long getLong(const Item *item);
+    float getFloat(const Item *item);
+    String getString(const Item *item);
+    String getDecrypt(const Item *item);
+
+    void set(const Item *item, byte &b);
+    void set(const Item *item, unsigned short &s);
+    void set(const Item *item, unsigned long &l);
+    void set(const Item *item, float &f);
+    void set(const Item *item, String &s);
+    void set(const Item *item, char *s);
+    void setEncrypt(const Item *item, String &s);
+
+    void update();  // deferred commit of the changed settings
+    void flush();   // commit now, e.g. before a restart
     unsigned short getSize(byte datatype);
-    byte getDatatype(Item *item);
-    
-    // Waveform parameters
-    Item *WaveMode;            // [byte] [0..3]
-    Item *WaveMode100Percent;  // [ms] [0..65535]
-    Item *WaveEffect;          // [byte] [0..4]
-    Item *WaveEffectMagnitude; // [%] [0..100]
-    Item *WaveEffectGain;      // [float]
-    Item *WaveEffectTime;      // [ms] [0..65535]
-
-    // Triac parameters
-    Item *TriacMode;           // [byte] [0..1]
-    Item *LevelOff;            // [%] [0..100]
-    Item *LevelOn;             // [%] [0..100]
-    Item *LevelLounge;         // [%] [0..100]
-  
-    // Wifi parameters
-    Item *ssid;                // String 32
-    Item *password;            // String 64
-    Item *hostname;            // String 32
-    Item *NtpServer;           // String 32
-    Item *NtpZone;             // [byte] [-12..12]
-    Item *UseDST;              // [bool]
-    Item *UdpPort;             // [0..65535]
-    Item *UdpEnabled;          // [bool]
-    Item *UpdDebugLevel;       // [0..65535]
-
-    // MQTT parameters
-    Item *brokerAddress;       // String 32
-    Item *mqttPort;            // [0..65535]
-    Item *mqttUsername;        // String 32
-    Item *mqttPassword;        // String 64
-    Item *mainTopic;           // String 64
-    Item *mqttQos;             // [byte] [0..1]
-    Item *mqttRetain;          // [bool]
-    Item *UseMqtt;             // [bool]
-    Item *haDisco;             // [bool]
-    Item *haTopic;             // String 32
+    byte getDatatype(const Item *item);
+
+#define SETTINGS_ITEM(name, datatype, size, def, lo, hi, since) const Item *name;
+    SETTINGS_SCHEMA(SETTINGS_ITEM)
+#undef SETTINGS_ITEM
 
     unsigned short memsize;
   private:
     void initParameters();
-    void resetSettings(unsigned short start, unsigned short size);
-    boolean IsEmpty(unsigned short start, unsigned short size);
+    typedef void (cSettings::*migration)(const byte *image);
+    static const migration migrations[SETTINGS_VERSION];
+    void loadLegacy(byte *image);
+    void migrate(const byte *image, byte version, bool eeprom);
+    void migrateEeprom(const byte *image);
+    static unsigned short layoutStart(byte id, byte version);
+    static unsigned short layoutSize(byte version);
+    void loadItem(const Item *item, const byte *stored, bool plain);
+    void storeItem(const Item *item, byte *image);
+    void setDirty(const Item *item, const void *value, unsigned short size);
+    void commit();
+    void setDefaults(settingid first, settingid last);
+    boolean IsEmpty(const byte *image, settingid first, settingid last, byte version);
     void defaultDimmerParameters();
     void defaultWifiParameters();
     void defaultMqttParameters();
-    void defaultHaParameters(bool doUpdate);
+    void defaultHaParameters();
+    void defaultLampParameters();
     void aesDecrypt(char *input, char *output, int dataLength);
     void aesEncrypt(const char *input, char *output, int dataLength);
+    inline byte *field(const Item *item) {
+      return (byte *)&ram + item->offset;
+    }
+    template<typename T> static void assign(T &dst, double value) {
+      dst = (T)value;
+    }
+    template<size_t N, size_t M> static void assign(char (&dst)[N], const char (&value)[M]) { // raw, may hold zeros
+      memset(dst, 0, N);
+      memcpy(dst, value, min(N - 1, M - 1));
+    }
+    settingsdata ram;
+    CJournal journal;
+    uint64_t dirty;            // bit per settingid, changed since the last commit
+    bool pending;
+    bool compact;
+    unsigned long requested;   // [ms] first update() since the last commit
 };
 
 extern cSettings settings;
@@ -1,6 +1,6 @@
 /*
  * IOTDimmer - Settings
- * Reads and writes settings from EEPROM
+ * Settings in RAM, stored in a journal
  * Hardware: Lolin S2 Mini
  * Version 0.80
  * 14-5-2021
@@ -14,226 +14,203 @@ const unsigned char INITIALIZATION_VECTOR[] = {0x2C, 0xCF, 0x47, 0xFB, 0x48, 0x1
 const unsigned char CYPHER_KEY[] = {0xF2, 0x58, 0xC6, 0x81, 0x6C, 0x31, 0x06, 0x4D, 0x6C, 0x77, 0x70, 0x5E, 0xAA, 0xDC, 0xC3, 0xC9, 
                                     0xBF, 0x9A, 0xE8, 0x7C, 0x2E, 0x80, 0x6E, 0x7A, 0xB1, 0x0D, 0x0B, 0x6B, 0x13, 0x3E, 0xE1, 0x0C};
 
-Item::Item(byte _datatype, unsigned short _start) { // constructor
-  datatype = _datatype;
-  start = _start;
-  size = settings.getSize(_datatype);
-}
+const Item settingSchema[SETTINGS_COUNT] = {
+#define SETTINGS_ENTRY(name, datatype, size, def, lo, hi, since) {datatype, settingStart(sid_##name), size, (unsigned short)offsetof(settingsdata, name), lo, hi, since},
+  SETTINGS_SCHEMA(SETTINGS_ENTRY)
+#undef SETTINGS_ENTRY
+};
 
-Item::Item(byte _datatype, unsigned short _start, unsigned short _size) { // constructor
-  datatype = _datatype;
-  start = _start;
-  size = _size;
-}
+// conversions from layout n to n + 1 that copying the settings and defaulting new ones does not cover
+const cSettings::migration cSettings::migrations[SETTINGS_VERSION] = {
+  &cSettings::migrateEeprom,  // 0 -> 1
+};
 
 cSettings::cSettings() { // constructor
   initParameters();
 }
 
 cSettings::~cSettings() { // destructor
-  EEPROM.end();
 }
 
 void cSettings::init() {
-  EEPROM.begin(EEPROM_SIZE); //Initialasing EEPROM
-#if 0
-  int i;
-  byte b;
-  String data = "";
-  for (i=0; i<haTopic->start + haTopic->size; i++) {
-    EEPROM.get(i, b);
-    data += String(b, HEX) + "-";
+  byte image[EEPROM_SIZE];
+  unsigned short length = EEPROM_SIZE;
+  byte version = 0;
+
+  if (!journal.load(image, length, version)) { // the only read of the stored settings
+    logger.printf("Settings: No journal, importing EEPROM settings");
+    loadLegacy(image);
+    migrate(image, 0, true);
+  } else if ((version > SETTINGS_VERSION) || (length != layoutSize(version))) { // newer firmware wrote it
+    logger.printf("Settings: Unknown layout " + String(version) + ", importing EEPROM settings");
+    loadLegacy(image);
+    migrate(image, 0, true);
+  } else if (version < SETTINGS_VERSION) {
+    migrate(image, version, false);
+  } else {
+    for (byte id = 0; id < SETTINGS_COUNT; id++) {
+      loadItem(&settingSchema[id], image + settingSchema[id].start, false);
+    }
+    logger.printf("Settings: Journal record " + String(journal.getSeq()) + " (" + String(journal.getDeltas()) + " deltas)");
   }
-  logger.printf(data);
-#endif
 #ifdef FORCE_DEFAULTS
   logger.printf("Settings: Forcing default settings");
-  resetSettings(WaveMode->start, (haTopic->start + haTopic->size) - WaveMode->start);
+  setDefaults(sid_WaveMode, (settingid)(SETTINGS_COUNT - 1));
+  commit();
 #endif
-  
-  if (IsEmpty(WaveMode->start, (TriacMode->start + TriacMode->size) - WaveMode->start)) {
-    logger.printf("Settings: No Dimmer settings, loading default");
-    defaultDimmerParameters();
-  }
-  if (IsEmpty(ssid->start, (UpdDebugLevel->start + UpdDebugLevel->size) - ssid->start)) {
-    logger.printf("Settings: No wifi settings, loading default");
-    defaultWifiParameters();
-  }
-  if (IsEmpty(brokerAddress->start, (haTopic->start + haTopic->size) - brokerAddress->start)) {
-    logger.printf("Settings: No mqtt settings, loading default");
-    defaultMqttParameters();
-  }
-  if (IsEmpty(haTopic->start, haTopic->size)) {
-    defaultHaParameters(true);
+  dirty = 0;
+  pending = false;
+}
+
+void cSettings::handle() {
+  if ((pending) && ((millis() - requested) >= SETTINGS_COMMIT_MS)) {
+    commit();
+  } else if ((!pending) && (compact)) { // fold the deltas into a snapshot while idle
+    byte image[EEPROM_SIZE];
+    compact = false;
+    for (byte id = 0; id < SETTINGS_COUNT; id++) {
+      storeItem(&settingSchema[id], image);
+    }
+    if (journal.snapshot(image, memsize, SETTINGS_VERSION)) {
+      logger.printf("Settings: Journal compacted, record " + String(journal.getSeq()));
+    }
   }
-
-#ifdef DO_ENCRYPT
-  Item *oldItem = new Item(DT_STRING, ssid->start, ssid->size);
-  String value;
-  get(oldItem, value);
-  set(ssid, value);
-  oldItem->start = password->start;
-  oldItem->size = password->size;  
-  get(oldItem, value);
-  set(password, value);
-  oldItem->start = mqttUsername->start;
-  oldItem->size = mqttUsername->size;
-  get(oldItem, value);
-  set(mqttUsername, value);
-  oldItem->start = mqttPassword->start;
-  oldItem->size = mqttPassword->size;
-  get(oldItem, value);
-  set(mqttPassword, value);  
-  update();
-#endif
 }
 
-void cSettings::get(Item *item, byte &b) {
+void cSettings::get(const Item *item, byte &b) {
   if (item->datatype == DT_BYTE) {
-    EEPROM.get(item->start, b);
+    b = *field(item);
   }
 }
 
-void cSettings::get(Item *item, unsigned short &s) {
+void cSettings::get(const Item *item, unsigned short &s) {
   if (item->datatype == DT_SHORT) {
-    EEPROM.get(item->start, s);
+    memcpy(&s, field(item), sizeof(s));
   }
 }
 
-void cSettings::get(Item *item, unsigned long &l) {
+void cSettings::get(const Item *item, unsigned long &l) {
   if (item->datatype == DT_LONG) {
-    EEPROM.get(item->start, l);
+    memcpy(&l, field(item), sizeof(l));
   }
 }
 
-void cSettings::get(Item *item, float &f) {
+void cSettings::get(const Item *item, float &f) {
   if (item->datatype == DT_FLOAT) {
-    EEPROM.get(item->start, f);
+    memcpy(&f, field(item), sizeof(f));
   }
 }
 
-void cSettings::get(Item *item, String &s) {
-  if (item->datatype == DT_STRING) {
-    char c = '-';
-    s = "";
-    for (unsigned short i = 0; ((i < item->size) && (c != '\0')); i++) {
-      c = char(EEPROM.read(item->start + i));
-      if (c != '\0') {
-        s += c;
-      }
-    }
-  } else if (item->datatype == DT_CYPHER) {
-    s = getDecrypt(item);
+void cSettings::get(const Item *item, String &s) {
+  if ((item->datatype == DT_STRING) || (item->datatype == DT_CYPHER)) {
+    s = String((const char *)field(item));
   }
 }
 
-void cSettings::get(Item *item, char *s) {
+void cSettings::get(const Item *item, char *s) {
   if ((item->datatype == DT_STRING) || (item->datatype == DT_CYPHER)) {
-    char c = '-';
-    for (unsigned short i = 0; (i < item->size); i++) {
-      s[i] = char(EEPROM.read(item->start + i));
-    }
+    memcpy(s, field(item), item->size);
   }
 }
 
-byte cSettings::getByte(Item *item) {
+byte cSettings::getByte(const Item *item) {
   byte b;
   get(item, b);
   return b;
 }
 
-unsigned short cSettings::getShort(Item *item) {
+unsigned short cSettings::getShort(const Item *item) {
   unsigned short s;
   get(item, s);
   return s;
 }
 
-unsigned long cSettings::getLong(Item *item) {
+unsigned long cSettings::getLong(const Item *item) {
   unsigned long l;
   get(item, l);
   return l;
 }
 
-float cSettings::getFloat(Item *item) {
+float cSettings::getFloat(const Item *item) {
   float f;
   get(item, f);
   return f;
 }
 
-String cSettings::getString(Item *item) {
+String cSettings::getString(const Item *item) {
   String s;
   get(item, s);
   return s;
 }
 
-String cSettings::getDecrypt(Item *item) {
-  char encrypted[item->size] = {0};
-  char decrypted[item->size] = {0};
-  get(item, encrypted);
-  aesDecrypt(encrypted, decrypted, item->size);
-  return String(decrypted);
+String cSettings::getDecrypt(const Item *item) { // held decrypted
+  return getString(item);
 }
 
-void cSettings::set(Item *item, byte &b) {
+void cSettings::set(const Item *item, byte &b) {
   if (item->datatype == DT_BYTE) {
-    EEPROM.put(item->start, b);
+    if (item->max > item->min) {
+      b = (byte)constrain((long)b, item->min, item->max);
+    }
+    setDirty(item, &b, sizeof(b));
   }
 }
 
-void cSettings::set(Item *item, unsigned short &s) {
+void cSettings::set(const Item *item, unsigned short &s) {
   if (item->datatype == DT_SHORT) {
-    EEPROM.put(item->start, s);
+    if (item->max > item->min) {
+      s = (unsigned short)constrain((long)s, item->min, item->max);
+    }
+    setDirty(item, &s, sizeof(s));
   }
 }
 
-void cSettings::set(Item *item, unsigned long &l) {
+void cSettings::set(const Item *item, unsigned long &l) {
   if (item->datatype == DT_LONG) {
-    EEPROM.put(item->start, l);
+    setDirty(item, &l, sizeof(l));
   }
 }
 
-void cSettings::set(Item *item, float &f) {
+void cSettings::set(const Item *item, float &f) {
   if (item->datatype == DT_FLOAT) {
-    EEPROM.put(item->start, f);
+    setDirty(item, &f, sizeof(f));
   }
 }
 
-void cSettings::set(Item *item, String &s) {
-  if (item->datatype == DT_STRING) {
+void cSettings::set(const Item *item, String &s) {
+  if ((item->datatype == DT_STRING) || (item->datatype == DT_CYPHER)) {
+    char value[item->size + 1] = {0};
     if (s.length() > item->size) {
       s = s.substring(0, item->size);
     }
-    unsigned short i;
-    for (i = 0; i < s.length(); i++) {
-      EEPROM.write(item->start + i, s[i]);
-    }
-    for (i = s.length(); i < item->size; i++) {
-      EEPROM.write(item->start + i, 0);
-    }
-  } else if (item->datatype == DT_CYPHER) {
-    setEncrypt(item, s);
+    memcpy(value, s.c_str(), s.length());
+    setDirty(item, value, item->size + 1);
   }
 }
 
-void cSettings::set(Item *item, char *s) {
+void cSettings::set(const Item *item, char *s) {
   if ((item->datatype == DT_STRING) || (item->datatype == DT_CYPHER)) {
-    unsigned short i;
-    for (i = 0; i < item->size; i++) {
-      EEPROM.write(item->start + i, s[i]);
-    }
+    char value[item->size + 1] = {0};
+    memcpy(value, s, item->size);
+    setDirty(item, value, item->size + 1);
   }
 }
 
-void cSettings::setEncrypt(Item *item, String &s) {
-  char decrypted[item->size] = {0};
-  char encrypted[item->size] = {0};
-  strcpy(decrypted, s.c_str());
-  aesEncrypt(decrypted, encrypted, item->size);
-  set(item, encrypted);
+void cSettings::setEncrypt(const Item *item, String &s) { // encrypted at commit
+  set(item, s);
 }
 
 void cSettings::update() {
-  EEPROM.commit();
+  if ((dirty != 0) && (!pending)) {
+    pending = true;
+    requested = millis();
+  }
+}
+
+void cSettings::flush() {
+  if (pending) {
+    commit();
+  }
 }
 
 unsigned short cSettings::getSize(byte datatype) {
@@ -258,99 +235,174 @@ unsigned short cSettings::getSize(byte datatype) {
   return dsize;
 }
 
-byte cSettings::getDatatype(Item *item) {
+byte cSettings::getDatatype(const Item *item) {
   return item->datatype;
 }
 
 ///////////// PRIVATES ///////////////////////////
 
 void cSettings::initParameters() {
-  unsigned short startAddress = EEPROM_START;
-
-  // Waveform parameters
-  WaveMode = new Item(DT_BYTE, startAddress);             // [byte] [0..3]
-  startAddress += getSize(DT_BYTE);
-  WaveMode100Percent = new Item(DT_SHORT, startAddress);  // [ms] [0..65535]
-  startAddress += getSize(DT_SHORT);
-  WaveEffect = new Item(DT_BYTE, startAddress);           // [byte] [0..4]
-  startAddress += getSize(DT_BYTE);
-  WaveEffectMagnitude = new Item(DT_BYTE, startAddress);  // [%] [0..100]
-  startAddress += getSize(DT_BYTE);
-  WaveEffectGain = new Item(DT_FLOAT, startAddress);      // [float]
-  startAddress += getSize(DT_FLOAT);
-  WaveEffectTime = new Item(DT_SHORT, startAddress);      // [ms] [0..65535]
-  startAddress += getSize(DT_SHORT);
-
-  // Triac parameters
-  TriacMode = new Item(DT_BYTE, startAddress);            // [%] [0..100]
-  startAddress += getSize(DT_BYTE);
-  LevelOff = new Item(DT_BYTE, startAddress);             // [%] [0..100]
-  startAddress += getSize(DT_BYTE);
-  LevelOn = new Item(DT_BYTE, startAddress);              // [%] [0..100]
-  startAddress += getSize(DT_BYTE);
-  LevelLounge = new Item(DT_BYTE, startAddress);          // [%] [0..100]
-  startAddress += getSize(DT_BYTE);
-
-  // Wifi parameters
-  ssid = new Item(DT_CYPHER, startAddress, STANDARD_SIZE);
-  startAddress += STANDARD_SIZE;
-  password = new Item(DT_CYPHER, startAddress, PASSWORD_SIZE);
-  startAddress += PASSWORD_SIZE;
-  hostname = new Item(DT_STRING, startAddress, STANDARD_SIZE);
-  startAddress += STANDARD_SIZE;
-  NtpServer = new Item(DT_STRING, startAddress, STANDARD_SIZE);
-  startAddress += STANDARD_SIZE;
-  NtpZone = new Item(DT_BYTE, startAddress);              // [byte] [-12..12]
-  startAddress += getSize(DT_BYTE);
-  UseDST = new Item(DT_BYTE, startAddress);               // [bool]
-  startAddress += getSize(DT_BYTE);
-  UdpPort = new Item(DT_SHORT, startAddress);             // [0..65535]
-  startAddress += getSize(DT_SHORT);
-  UdpEnabled = new Item(DT_BYTE, startAddress);           // [bool]
-  startAddress += getSize(DT_BYTE);
-  UpdDebugLevel = new Item(DT_SHORT, startAddress);       // [0..65535]
-  startAddress += getSize(DT_SHORT);
-
-  // MQTT parameters
-  brokerAddress = new Item(DT_STRING, startAddress, STANDARD_SIZE);
-  startAddress += STANDARD_SIZE;
-  mqttPort = new Item(DT_SHORT, startAddress);            // [0..65535]
-  startAddress += getSize(DT_SHORT);
-  mqttUsername = new Item(DT_CYPHER, startAddress, STANDARD_SIZE);
-  startAddress += STANDARD_SIZE;
-  mqttPassword = new Item(DT_CYPHER, startAddress, PASSWORD_SIZE);
-  startAddress += PASSWORD_SIZE;
-  mainTopic = new Item(DT_STRING, startAddress, PASSWORD_SIZE);
-  startAddress += PASSWORD_SIZE;
-  mqttQos = new Item(DT_BYTE, startAddress);               // [byte] [0..1]
-  startAddress += getSize(DT_BYTE);
-  mqttRetain = new Item(DT_BYTE, startAddress);            // [bool]
-  startAddress += getSize(DT_BYTE);
-  UseMqtt = new Item(DT_BYTE, startAddress);               // [bool]
-  startAddress += getSize(DT_BYTE);
-  haDisco = new Item(DT_BYTE, startAddress);               // [bool]
-  startAddress += getSize(DT_BYTE);
-  haTopic = new Item(DT_STRING, startAddress, STANDARD_SIZE);
-  startAddress += PASSWORD_SIZE;
-
-  memsize = startAddress;
-}
-
-void cSettings::resetSettings(unsigned short start, unsigned short size) {
-  byte bval = 0xFF;
-
-  for (int i=0; i < size; i++) {
-    EEPROM.write(start + i, bval);
-  }
-  update();
-}
-
-boolean cSettings::IsEmpty(unsigned short start, unsigned short size) {
+#define SETTINGS_POINTER(name, datatype, size, def, lo, hi, since) name = &settingSchema[sid_##name];
+  SETTINGS_SCHEMA(SETTINGS_POINTER)
+#undef SETTINGS_POINTER
+  memset(&ram, 0, sizeof(ram));
+  memsize = settingStart(SETTINGS_COUNT);
+  dirty = 0;
+  pending = false;
+  compact = false;
+  requested = 0;
+}
+
+void cSettings::loadLegacy(byte *image) { // EEPROM settings of earlier versions, layout 0
+  EEPROM.begin(EEPROM_SIZE);
+  for (unsigned short i = 0; i < layoutSize(0); i++) {
+    image[i] = EEPROM.read(i);
+  }
+  EEPROM.end();
+}
+
+void cSettings::migrate(const byte *image, byte version, bool eeprom) { // once, the result is stored in the current layout
+  byte stored[EEPROM_SIZE];
+  logger.printf("Settings: Migrating layout " + String(version) + " to " + String(SETTINGS_VERSION));
+  for (byte id = 0; id < SETTINGS_COUNT; id++) {
+    if (settingSchema[id].since <= version) {
+      loadItem(&settingSchema[id], image + layoutStart(id, version), false);
+    } else {
+      setDefaults((settingid)id, (settingid)id);
+    }
+  }
+#ifdef DO_ENCRYPT
+  if (eeprom) { // EEPROM stored them plain
+    for (byte id = 0; id < SETTINGS_COUNT; id++) {
+      if (settingSchema[id].datatype == DT_CYPHER) {
+        loadItem(&settingSchema[id], image + layoutStart(id, 0), true);
+      }
+    }
+  }
+#endif
+  for (byte v = version; v < SETTINGS_VERSION; v++) {
+    if (migrations[v] != NULL) {
+      (this->*migrations[v])(image);
+    }
+  }
+  for (byte id = 0; id < SETTINGS_COUNT; id++) {
+    storeItem(&settingSchema[id], stored);
+  }
+  journal.snapshot(stored, memsize, SETTINGS_VERSION);
+}
+
+void cSettings::migrateEeprom(const byte *image) { // groups never saved get their defaults
+  if (IsEmpty(image, sid_WaveMode, sid_TriacMode, 0)) {
+    logger.printf("Settings: No Dimmer settings, loading default");
+    defaultDimmerParameters();
+  }
+  if (IsEmpty(image, sid_ssid, sid_UpdDebugLevel, 0)) {
+    logger.printf("Settings: No wifi settings, loading default");
+    defaultWifiParameters();
+  }
+  if (IsEmpty(image, sid_brokerAddress, sid_haTopic, 0)) {
+    logger.printf("Settings: No mqtt settings, loading default");
+    defaultMqttParameters();
+  }
+  if (IsEmpty(image, sid_haTopic, sid_haTopic, 0)) {
+    defaultHaParameters();
+  }
+  if (IsEmpty(image, sid_LampCurve, sid_LampPoints, 0)) {
+    logger.printf("Settings: No lamp settings, loading default");
+    defaultLampParameters();
+  }
+}
+
+unsigned short cSettings::layoutStart(byte id, byte version) { // address in an older layout
+  unsigned short start = EEPROM_START;
+  for (byte i = 0; i < id; i++) {
+    if (settingSchema[i].since <= version) {
+      start += settingSchema[i].size;
+    }
+  }
+  return start;
+}
+
+unsigned short cSettings::layoutSize(byte version) {
+  return layoutStart(SETTINGS_COUNT, version) - EEPROM_START;
+}
+
+void cSettings::loadItem(const Item *item, const byte *stored, bool plain) {
+  byte *dst = field(item);
+  memcpy(dst, stored, item->size);
+  if ((item->datatype == DT_CYPHER) && (!plain)) {
+    char decrypted[item->size] = {0};
+    aesDecrypt((char *)dst, decrypted, item->size);
+    memcpy(dst, decrypted, item->size);
+  }
+  if ((item->datatype == DT_STRING) || (item->datatype == DT_CYPHER)) {
+    dst[item->size] = 0;
+  }
+}
+
+void cSettings::storeItem(const Item *item, byte *image) {
+  if (item->datatype == DT_CYPHER) {
+    char decrypted[item->size] = {0};
+    memcpy(decrypted, field(item), item->size);
+    aesEncrypt(decrypted, (char *)image + item->start, item->size);
+  } else {
+    memcpy(image + item->start, field(item), item->size);
+  }
+}
+
+void cSettings::setDirty(const Item *item, const void *value, unsigned short size) { // copy to RAM, only changes are committed
+  if (memcmp(field(item), value, size) != 0) {
+    memcpy(field(item), value, size);
+    dirty |= 1ULL << (item - settingSchema);
+  }
+}
+
+void cSettings::commit() { // journal record of the changed settings
+  byte image[EEPROM_SIZE];
+  unsigned short starts[SETTINGS_COUNT];
+  unsigned short sizes[SETTINGS_COUNT];
+  byte count = 0;
+
+  pending = false;
+  for (byte id = 0; id < SETTINGS_COUNT; id++) { // full image, the journal may take a snapshot
+    storeItem(&settingSchema[id], image);
+    if (dirty & (1ULL << id)) {
+      starts[count] = settingSchema[id].start;
+      sizes[count] = settingSchema[id].size;
+      count++;
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+  if (journal.append(image, memsize, starts, sizes, count)) {
+    dirty = 0;
+    compact = journal.needsCompact();
+    logger.printf("Settings: " + String(count) + " changed, journal record " + String(journal.getSeq()));
+  } else {
+    logger.printf("Settings: Journal write failed");
+  }
+}
+
+void cSettings::setDefaults(settingid first, settingid last) {
+  for (byte id = first; id <= last; id++) {
+    switch (id) {
+#define SETTINGS_DEFAULT(name, datatype, size, def, lo, hi, since) case sid_##name: assign(ram.name, def); break;
+      SETTINGS_SCHEMA(SETTINGS_DEFAULT)
+#undef SETTINGS_DEFAULT
+    }
+    dirty |= 1ULL << id;
+  }
+}
+
+boolean cSettings::IsEmpty(const byte *image, settingid first, settingid last, byte version) {
   boolean empty = true;
   byte rd = 0;
+  unsigned short start = layoutStart(first, version);
+  unsigned short end = layoutStart(last, version) + settingSchema[last].size;
 
-  for (int i=0; ((i < size) && (empty)); i++) {
-    rd = EEPROM.read(start + i);
+  for (int i=start; ((i < end) && (empty)); i++) {
+    rd = image[i];
     if ((rd != 0x00) && (rd != 0xFF)) {
       empty = false;
     }
@@ -359,62 +411,24 @@ boolean cSettings::IsEmpty(unsigned short start, unsigned short size) {
 }
 
 void cSettings::defaultDimmerParameters() {
-  unsigned short val = 0;
-  float fval = 0;
-  byte bval = true;
-  set(WaveMode, bval = DEF_MODE);
-  set(WaveMode100Percent, val = DEF_MODE100);
-  set(WaveEffect, bval = DEF_EFFECT);
-  set(WaveEffectMagnitude, bval = DEF_EFFECT_MAG);
-  set(WaveEffectGain, fval = DEF_EFFECT_GAIN);
-  set(WaveEffectTime, val = DEF_EFFECT_TIME);
-  set(TriacMode, bval = DEF_TRIAC_MODE);
-  set(LevelOff, bval = DEF_LEVEL_OFF);
-  set(LevelOn, bval = DEF_LEVEL_ON);
-  set(LevelLounge, bval = DEF_LEVEL_LOUNGE);
-  update();
+  setDefaults(sid_WaveMode, sid_LevelLounge);
 }
 
 void cSettings::defaultWifiParameters() {
-  unsigned short val = 0;
-  String sval = "";
-  byte bval = true;
-  set(ssid, sval = DEF_SSID);
-  set(password, sval = DEF_PASSWORD);
-  set(hostname, sval = DEF_HOSTNAME);
-  set(NtpServer, sval = DEF_NTPSERVER);
-  set(NtpZone, bval = DEF_NTPZONE);
-  set(UseDST, bval = DEF_USEDST);
-  set(UdpPort, val = DEF_LOGPORT);
-  set(UdpEnabled, bval = DEF_LOGENABLE);
-  set(UpdDebugLevel, val = DEF_LOGDEBUG);  
-  update();
+  setDefaults(sid_ssid, sid_UpdDebugLevel);
 }
 
 void cSettings::defaultMqttParameters() {
-  String sval = "";
-  byte bval = true;
-  unsigned short val = 0;
-  set(brokerAddress, sval = DEF_BROKERADDRESS);
-  set(mqttPort, val = DEF_MQTTPORT);
-  set(mqttUsername, sval = DEF_MQTTUSERNAME);
-  set(mqttPassword, sval = DEF_MQTTPASSWORD);
-  set(mainTopic, sval = DEF_MAINTOPIC);
-  set(mqttQos, bval = DEF_MQTTQOS);
-  set(mqttRetain, bval = DEF_MQTTRETAIN);
-  set(UseMqtt, bval = DEF_USEMQTT);
-  defaultHaParameters(false);
-  update();
-}
-
-void cSettings::defaultHaParameters(bool doUpdate) {
-  String sval = "";
-  byte bval = true;
-  set(haDisco, bval = DEF_HADISCO);
-  set(haTopic, sval = DEF_HATOPIC);
-  if (doUpdate) {
-    update();
-  }
+  setDefaults(sid_brokerAddress, sid_UseMqtt);
+  defaultHaParameters();
+}
+
+void cSettings::defaultHaParameters() {
+  setDefaults(sid_haDisco, sid_haSpare);
+}
+
+void cSettings::defaultLampParameters() {
+  setDefaults(sid_LampCurve, sid_LampPoints);
 }
 
 void cSettings::aesDecrypt(char *input, char *output, int dataLength) {
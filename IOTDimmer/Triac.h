@@ -16,9 +16,31 @@
 #define IGNITION_MAX   100000 // maximum ignition time if no zero crossing
 #define SAFETY_TIME_US 100
 #define STABILIZER_NR  6      // about 1 second (= 6.25 @ 50Hz)
+#define TABLE_DRIFT_US 25     // rebuild ignition table if zero time drifts more than 25 us
+
+#define PLL_FRAC       4      // fixed point fraction bits of pll period and error
+#define PLL_KP_SHIFT   2      // phase correction gain = 1/4
+#define PLL_KI_SHIFT   4      // period correction gain = 1/16
+#define PLL_AV_SHIFT   3      // phase error filter = 1/8
+#define PLL_GLITCH_US  500    // reject edges further from predicted zero crossing when locked
+#define PLL_LOCK_US    100    // edges within this window count for locking
+#define PLL_LOCK_NR    8      // consecutive edges within lock window to lock
+#ifndef PLL_MISSED_MAX
+#define PLL_MISSED_MAX 3      // missed edges, and rejected edges in a row, to ride through before losing lock
+#endif
+
+#define CAPTURE_TICKS_US 80   // mcpwm capture clock (APB) ticks per us
 
 #define PWR_ON         100
 #define PWR_OFF        0
+#define LEVEL_ON       65535UL // internal level, percent is an adapter
+#define LEVEL_OFF      0
+#define LEVEL_PERCENT(p) ((unsigned short)(((unsigned long)(p)*LEVEL_ON + PWR_ON/2)/PWR_ON))
+#define PERCENT_LEVEL(l) ((byte)(((unsigned long)(l)*PWR_ON + LEVEL_ON/2)/LEVEL_ON))
+#define LEVEL_DIM_MIN  LEVEL_PERCENT(PWR_OFF+1) // dimmed levels stay within 1..99 %
+#define LEVEL_DIM_MAX  LEVEL_PERCENT(PWR_ON-1)
+
+#include "Ignition.h"
 
 #if defined(ARDUINO_ARCH_AVR)
 #define ZEROCROSS_PIN  2
@@ -30,6 +52,21 @@ typedef int portMUX_TYPE; // get ESP mutex and IRAM work on arduino
 #define portEXIT_CRITICAL(mux)
 #define portMUX_INITIALIZER_UNLOCKED 0
 #define IRAM_ATTR
+#define DRAM_ATTR
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef int StaticSemaphore_t;
+typedef int BaseType_t;
+#define pdFALSE 0
+#define portMAX_DELAY 0
+#define xSemaphoreCreateRecursiveMutexStatic(buffer) NULL
+#define xSemaphoreTakeRecursive(mutex, wait)
+#define xSemaphoreGiveRecursive(mutex)
+#define vTaskNotifyGiveFromISR(task, woken)
+#define portYIELD_FROM_ISR()
+#if defined(ZERO_CAPTURE)
+#error ZERO_CAPTURE is only available on ESP32
+#endif
 #else
 #ifndef ZEROCROSS_PIN
 #define ZEROCROSS_PIN  -1
@@ -39,57 +76,187 @@ typedef int portMUX_TYPE; // get ESP mutex and IRAM work on arduino
 #endif
 #endif
 
+#if defined(ZERO_CAPTURE)
+#include "soc/soc_caps.h"
+#if defined(SOC_MCPWM_SUPPORTED)
+#include "driver/mcpwm.h"     // edge timestamped by capture hardware
+#endif                        // else cycle counter at isr entry (ESP32-S2 has no mcpwm)
+#endif
+
+#ifndef TRIAC_CHANNELS
+#define TRIAC_CHANNELS 1      // dimmer channels sharing one zero cross input [1..4]
+#endif
+#ifndef TRIGGER_PINS
+#define TRIGGER_PINS   {TRIGGER_PIN}
+#endif
+#define TRIAC_EVENTS   (2*TRIAC_CHANNELS) // ignition and pulse end for every channel
+#define EVENT_MERGE_US 2      // handle events closer together in the same timer interrupt
+#define FADE_BITS      28     // fade phase resolution, fades up to hours keep a step > 1
+#define FADE_ONE       (1UL << FADE_BITS) // fade phase of a completed fade
+#define FADE_SHIFT     15     // fade curve is Q15 (CURVE_SHIFT)
+
+const int triggerPins[TRIAC_CHANNELS] = TRIGGER_PINS;
+
 typedef void (*lowpower_cb)(bool);
 
 class CTriac {
 public:
-  enum triacmode {timed = 0, power = 1};
+  enum triacmode {timed = 0, power = 1, burst = 2};
+  enum fadecurve {flinear = 0, fsine = 1, fqsine = 2};
   CTriac(); // constructor
   void init(void);
   void handle(void);
   void reset(void);
   float getFreq();
-  void setPower(byte power);
-  byte getPower();
+  void setPower(byte power, byte channel = 0);
+  void setLevel(unsigned short level, byte channel = 0);
+  void setFade(unsigned short level, unsigned long duration, fadecurve curve, byte channel = 0);
+  byte getPower(byte channel = 0);
+  unsigned short getLevel(byte channel = 0);
   byte getMode();
   void setMode(byte mode);
+  void setCalibration();
   void setCallback(void *cb);
+  void setNotify(TaskHandle_t task);
+  bool getLocked();
+  bool getCalibrated();
+  float getPhaseError();
+  unsigned long getGlitches();
+  float getZeroLatency();
+  unsigned long getZeroLatencyMax();
 private:
-  enum triacstate {idle = 0, zero = 1, pulse = 2, off = 3, on = 4, zerouncalibrated = 5, zerocalibrating = 6};
-  struct triacdata {
-    triacstate state;
+  enum triacstate {idle = 0, zero = 1, off = 2, zerouncalibrated = 3, zerocalibrating = 4};
+  enum channelstate {choff = 0, chon = 1, chdim = 2, chburst = 3};
+  struct channeldata {
+    channelstate state;      // requested state, the isr runs on the published config
     unsigned long igniteTime;
+    unsigned short burstLevel; // [LEVEL_ON] half cycles to conduct in burst mode
+    unsigned long burstSum;  // sigma delta accumulator
+    unsigned long fadeSeq;   // fade the isr runs
+    unsigned long fadePhase; // [FADE_ONE] progress of running fade
+    bool fading;
+  };
+  struct fadedata {          // ramp stepped by the isr every half cycle
+    unsigned long seq;       // changes for every new fade or power
+    long start;              // [us] ignition time or [LEVEL_ON] burst level
+    long end;
+    unsigned long step;      // [FADE_ONE] phase per half cycle, 0 = no fade
+    fadecurve curve;
+  };
+  struct triacevent {
+    unsigned long time;      // [us] after zero crossing
+    byte channel;
+    byte level;
+  };
+  struct eventlist {
+    triacevent event[TRIAC_EVENTS];
+    byte count;
+  };
+  struct triacconfig {       // published by the main loop, taken over by the isr at zero crossing
+    channelstate state[TRIAC_CHANNELS];
+    unsigned long ignite[TRIAC_CHANNELS];
+    unsigned short burstLevel[TRIAC_CHANNELS];
+    fadedata fade[TRIAC_CHANNELS];
     unsigned long pulseWidth;
+    eventlist events;        // sorted events of a half cycle
+    bool dimming;            // any channel dimming or bursting
+  };
+  struct triacdata {
+    triacstate state;
     unsigned long zeroStamp;
+    unsigned long eventZero; // [us] zero crossing the running event list refers to
+    byte eventIndex;
     unsigned long movAvMemory[MOVAV_WIDTH];
+    unsigned long movAvSum;
+    unsigned long movAvSeq; // odd while isr_ext updates the moving average
     byte movAvCounter;
     byte stabilizerCounter;
     bool movAvValid;
   };
-  void setZero(byte power);
+  struct plldata {
+    long period;             // [us << PLL_FRAC] tracked zero time
+    unsigned long nextZero;  // [us] predicted next zero crossing
+    unsigned long estZero;   // [us] filtered last zero crossing
+    unsigned long flyZero;   // [us] zero crossing the flywheel ignition is armed for
+    long phaseError;         // [us] phase error of last accepted edge
+    unsigned long errorAv;   // [us << PLL_FRAC] filtered absolute phase error
+    unsigned long glitches;  // rejected edges since boot
+    byte missed;             // edges missed in a row
+    byte rejected;           // edges rejected in a row
+    byte skipped;
+    byte lockCounter;
+    bool locked;
+    bool flywheel;
+  };
+  struct capturedata {
+    unsigned long ticks;     // [APB ticks] last captured edge
+    unsigned long frac;      // [APB ticks] remainder not yet added to stamp
+    unsigned long stamp;     // [us] last captured edge on the micros() time line
+    unsigned long latencyAv; // [us << PLL_FRAC] filtered latency removed
+    unsigned long latencyMax;// [us]
+    bool valid;
+  };
+  void lock();
+  void unlock();
+  void setZero(bool active);
   void zeroOn();
   void zeroOff();
   void calibrateZero();
   void testZeroCalibrated();
-  unsigned long calcPowerMode(byte power);
-  unsigned long calcTimedMode(byte power);
-  byte calcFromPowerMode(unsigned long ignTime);
-  byte calcFromTimedMode(unsigned long ignTime);
+  void updateIgnitionTable();
+  void buildIgnitionTable(unsigned long zeroTime); // not with writeMutex held, it is released while building
+  unsigned short calcFromIgnitionTable(unsigned long ignTime);
   unsigned long getZeroTime();
-  void setIgniteTime(unsigned long ignTime, byte &power);
-  unsigned long getIgniteTime();
-  void setState(byte power);
+  unsigned long calcIgniteTime(unsigned short level);
+  unsigned long safeIgniteTime(unsigned long ignTime, unsigned long zeroTime);
+  void setIgniteTime(byte channel, unsigned long ignTime, unsigned short &level);
+  unsigned long getIgniteTime(byte channel);
+  void setState(byte channel, unsigned short level);
+  void publishConfig();
+  static void IRAM_ATTR insertEvent(eventlist &list, unsigned long time, byte channel, byte level);
   void ClearMovAvFilter();
   triacmode dimMode;
+  CIgnition tables[2];       // running and spare, a rebuild never writes the table that is read
+  volatile byte tableIndex;  // running table, swapped with writeMutex held
+  bool tableStale;           // lamp curve changed, rebuild when the zero time is known
+  bool tableBuilding;
+  unsigned long pulseWidth;
+  fadedata fade[TRIAC_CHANNELS];
   bool zeroState;
+  bool pllLocked;
   lowpower_cb lpCallback;
+  SemaphoreHandle_t writeMutex; // one writer at a time, the waveform engine and the main loop both set levels
+  StaticSemaphore_t writeMutexBuffer;
 
   // static
   static portMUX_TYPE movAvMux;
   static portMUX_TYPE stateMux;
   volatile static triacdata triacData;
+  volatile static channeldata channelData[TRIAC_CHANNELS];
+  volatile static triacconfig configs[2];
+  volatile static byte configIndex; // config the isr runs on, the other one is written by the main loop
+  volatile static bool configUpdate;
   volatile static unsigned long zeroSample;
+  volatile static plldata pllData;
+  volatile static capturedata captureData;
+  static TaskHandle_t notifyTask;
+  static unsigned long cpuMHz;
+  static void pllReset();
+  static bool IRAM_ATTR pllUpdate(unsigned long stamp);
+  static void IRAM_ATTR pllFlywheel();
+  static void IRAM_ATTR applyConfig();
+  static void IRAM_ATTR burstFire();
+  static void IRAM_ATTR fadeStep();
+  static long IRAM_ATTR fadeCurve(fadecurve curve, unsigned long phase);
+  static void IRAM_ATTR setTrigger(byte channel, byte level);
+  static bool IRAM_ATTR armEvents(unsigned long zeroStamp, unsigned long stamp);
+  static unsigned long IRAM_ATTR getEventDelay(unsigned long time, unsigned long stamp);
+  static void IRAM_ATTR captureLatency(unsigned long latency);
+  static void IRAM_ATTR zeroEdge(unsigned long stamp, unsigned long now);
   static void IRAM_ATTR isr_ext();
+#if defined(ZERO_CAPTURE) && defined(SOC_MCPWM_SUPPORTED)
+  static bool IRAM_ATTR isr_capture(mcpwm_unit_t mcpwm, mcpwm_capture_channel_id_t cap, const cap_event_data_t *edata, void *arg);
+#endif
   static void IRAM_ATTR isr_timer();
 };
 
@@ -10,46 +10,108 @@
 #include <math.h>
 #include "Triac.h"
 #include "HWtimer.h"
+#include "Trigger.h"
+#include "Diag.h"
+#include "Curves.h"
+
+typedef CHwTimerFixed<ZERO_MAX> CTriacTimer; // prescaler and tick conversion fixed at compile time
 
 portMUX_TYPE CTriac::stateMux = portMUX_INITIALIZER_UNLOCKED;
 portMUX_TYPE CTriac::movAvMux = portMUX_INITIALIZER_UNLOCKED;
-volatile CTriac::triacdata CTriac::triacData = {CTriac::idle, 0, 0, 0, {0}, 0,0, false};
+volatile CTriac::triacdata CTriac::triacData = {CTriac::idle, 0, 0, 0, {0}, 0, 0, 0, 0, false};
+volatile CTriac::channeldata CTriac::channelData[TRIAC_CHANNELS] = {};
+volatile CTriac::triacconfig CTriac::configs[2] = {};
+volatile byte CTriac::configIndex = 0;
+volatile bool CTriac::configUpdate = false;
 volatile unsigned long CTriac::zeroSample = 0;
+volatile CTriac::plldata CTriac::pllData = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, false, false};
+volatile CTriac::capturedata CTriac::captureData = {0, 0, 0, 0, 0, false};
+unsigned long CTriac::cpuMHz = 0;
+TaskHandle_t CTriac::notifyTask = NULL;
 
 CTriac::CTriac() { // constructor
   pinMode(ZEROCROSS_PIN, INPUT);
-  pinMode(TRIGGER_PIN, OUTPUT);
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+#if !defined(TRIAC_USE_RMT)
+    pinMode(triggerPins[ch], OUTPUT);
+#endif
+    channelData[ch].state = choff;
+    channelData[ch].igniteTime = 0;
+    channelData[ch].burstLevel = LEVEL_OFF;
+    channelData[ch].burstSum = 0;
+    channelData[ch].fadeSeq = 0;
+    channelData[ch].fadePhase = 0;
+    channelData[ch].fading = false;
+    fade[ch].seq = 0;
+    fade[ch].start = 0;
+    fade[ch].end = 0;
+    fade[ch].step = 0;
+    fade[ch].curve = flinear;
+  }
   dimMode = timed;
+  tableIndex = 0;
+  tableStale = false;
+  tableBuilding = false;
+  pulseWidth = 0;
   zeroState = false;
+  pllLocked = false;
   lpCallback = NULL;
+  writeMutex = xSemaphoreCreateRecursiveMutexStatic(&writeMutexBuffer);
   triacData.state = zerouncalibrated;
-  triacData.igniteTime = 0;
-  triacData.pulseWidth = 0;
   triacData.zeroStamp = 0;
-  triacData.movAvMemory[MOVAV_WIDTH] = {0};
+  triacData.eventZero = 0;
+  triacData.eventIndex = 0;
+  for (int i=0; i<MOVAV_WIDTH; i++) {
+    triacData.movAvMemory[i] = 0;
+  }
+  triacData.movAvSum = 0;
+  triacData.movAvSeq = 0;
   triacData.movAvCounter = 0;
   triacData.stabilizerCounter = 0;
   triacData.movAvValid = false;
 }
 
 void CTriac::init(void) {
-  hwtimer.init(hwtimer.getPrescaler(ZERO_MAX), TMR_SINGLE);
+  lock();
+  hwtimer.init(CTriacTimer::divider(), TMR_SINGLE);
   hwtimer.attachInterrupt(isr_timer);
+#if defined(TRIAC_USE_RMT)
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    trigger.init(ch, triggerPins[ch]);
+  }
+#endif
   setMode(settings.getByte(settings.TriacMode));
-  setPower(PWR_OFF);
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    setPower(PWR_OFF, ch);
+  }
   calibrateZero();
+  unlock();
 }
 
 void CTriac::handle(void) {
+#if defined(ZERO_CAPTURE) && !defined(SOC_MCPWM_SUPPORTED)
+  cpuMHz = getCpuFrequencyMhz(); // may be changed for low power
+#endif
+  lock();
   testZeroCalibrated();
+  unlock();
+  updateIgnitionTable();
+  if (pllData.locked != pllLocked) {
+    pllLocked = pllData.locked;
+    logger.printf(LOG_TRIAC, String(pllLocked ? "PLL locked" : "PLL unlocked") + ", glitches: " + String(pllData.glitches));
+  }
 }
 
 void CTriac::reset(void) {
   logger.printf(LOG_TRIAC, "Reset");
-  setPower(PWR_OFF);
+  lock();
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    setPower(PWR_OFF, ch);
+  }
   ClearMovAvFilter();
   triacData.state = zerouncalibrated;
   calibrateZero();
+  unlock();
 }
 
 float CTriac::getFreq(void) {
@@ -62,44 +124,126 @@ float CTriac::getFreq(void) {
   return freq;
 }
 
-void CTriac::setPower(byte power) {
+void CTriac::setPower(byte power, byte channel) {
+  setLevel(LEVEL_PERCENT(power), channel);
+}
+
+void CTriac::setLevel(unsigned short level, byte channel) {
   unsigned long ignTime = 0;
-  //logger.printf(LOG_TRIAC, "Setpower: " + String(power)); // don't log too much data
+  bool active = false;
+  //logger.printf(LOG_TRIAC, "Setlevel: " + String(level)); // don't log too much data
 
+  if (channel >= TRIAC_CHANNELS) {
+    return;
+  }
+  lock();
+  fade[channel].seq++; // stops a running fade
+  fade[channel].step = 0;
   if (triacData.state < zerouncalibrated) { 
-    if (dimMode == timed) {
-      ignTime = calcTimedMode(power);
-    } else { // power
-      ignTime = calcPowerMode(power);
+    if (dimMode == burst) {
+      channelData[channel].burstLevel = level;
+    } else {
+      ignTime = calcIgniteTime(level);
+      setIgniteTime(channel, ignTime, level);
+    }
+    setState(channel, level);
+    for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+      active |= (channelData[ch].state != choff);
     }
-    setIgniteTime(ignTime, power);
-    setState(power);
-    setZero(power);
+    setZero(active);
   } else {
-    setState(PWR_OFF);
+    setState(channel, LEVEL_OFF);
   }
+  unlock();
 }
 
-byte CTriac::getPower() {
-  byte power = PWR_OFF;
-  unsigned long ignTime = getIgniteTime();
+void CTriac::setFade(unsigned short level, unsigned long duration, fadecurve curve, byte channel) {
+  unsigned long zeroTime = getZeroTime();
+  unsigned long halfCycles = 0;
+  unsigned short from, to;
 
-  if (triacData.state == on) {
-    power = PWR_ON;
-  } else if (triacData.state < off) {
-    if (dimMode == timed) {
-      power = calcFromTimedMode(ignTime);
-    } else { // power
-      power = calcFromPowerMode(ignTime);
+  if (channel >= TRIAC_CHANNELS) {
+    return;
+  }
+  lock();
+  if ((triacData.state < zerouncalibrated) && (zeroTime >= ZERO_MIN)) {
+    halfCycles = (unsigned long)(((unsigned long long)duration*1000)/zeroTime);
+  }
+  // ramp over the dimmable range, the caller sets the final power at the end of the fade
+  from = constrain(getLevel(channel), LEVEL_DIM_MIN, LEVEL_DIM_MAX);
+  to = constrain(level, LEVEL_DIM_MIN, LEVEL_DIM_MAX);
+  if (halfCycles > 0) {
+    if (dimMode == burst) {
+      channelData[channel].burstLevel = to;
+      fade[channel].start = from;
+      fade[channel].end = to;
+    } else {
+      setIgniteTime(channel, calcIgniteTime(to), to);
+      fade[channel].start = safeIgniteTime(calcIgniteTime(from), zeroTime);
+      fade[channel].end = channelData[channel].igniteTime;
     }
   }
-  
-  return power;
+  if ((halfCycles == 0) || (to == LEVEL_OFF)) { // no zero crossings or ignition table yet
+    setLevel(level, channel);
+  } else {
+    fade[channel].step = (FADE_ONE + halfCycles - 1)/halfCycles;
+    fade[channel].curve = curve;
+    fade[channel].seq++;
+    setState(channel, to);
+    setZero(true);
+  }
+  unlock();
+}
+
+byte CTriac::getPower(byte channel) {
+  return PERCENT_LEVEL(getLevel(channel));
+}
+
+unsigned short CTriac::getLevel(byte channel) {
+  unsigned short level = LEVEL_OFF;
+
+  if (channel >= TRIAC_CHANNELS) {
+    return level;
+  }
+  lock();
+  if (channelData[channel].state == chon) {
+    level = LEVEL_ON;
+  } else if (channelData[channel].state == chburst) {
+    volatile triacconfig &cfg = configs[configIndex];
+    level = (cfg.state[channel] == chburst) ? cfg.burstLevel[channel] : channelData[channel].burstLevel; // running level, also while fading
+  } else if (channelData[channel].state == chdim) {
+    level = calcFromIgnitionTable(getIgniteTime(channel));
+  }
+  unlock();
+  return level;
 }
 
 void CTriac::setMode(byte mode) {
   logger.printf(LOG_TRIAC, "Setmode: " + String(mode));
+  lock();
   dimMode = (triacmode)mode;
+  unlock();
+  updateIgnitionTable();
+}
+
+void CTriac::setCalibration() { // lamp curve changed, keep the levels of dimmed channels
+  unsigned short level[TRIAC_CHANNELS];
+  unsigned long seq[TRIAC_CHANNELS];
+  lock();
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    level[ch] = getLevel(ch);
+    seq[ch] = fade[ch].seq;
+  }
+  tableStale = true;
+  unlock();
+  updateIgnitionTable();
+  lock();
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    if ((channelData[ch].state == chdim) && (fade[ch].seq == seq[ch])) { // not set again meanwhile
+      setLevel(level[ch], ch);
+    }
+  }
+  unlock();
 }
 
 byte CTriac::getMode() {
@@ -114,10 +258,46 @@ void CTriac::setCallback(void *cb) {
   }
 }
 
+void CTriac::setNotify(TaskHandle_t task) { // notified at every zero crossing
+  notifyTask = task;
+}
+
+bool CTriac::getCalibrated() { // zero crossing time known, levels are applied
+  return triacData.state < zerouncalibrated;
+}
+
+bool CTriac::getLocked() {
+  return pllData.locked;
+}
+
+float CTriac::getPhaseError() {
+  return ((float)pllData.errorAv)/(1 << PLL_FRAC);
+}
+
+unsigned long CTriac::getGlitches() {
+  return pllData.glitches;
+}
+
+float CTriac::getZeroLatency() {
+  return ((float)captureData.latencyAv)/(1 << PLL_FRAC);
+}
+
+unsigned long CTriac::getZeroLatencyMax() {
+  return captureData.latencyMax;
+}
+
 // Privates !!!!!!!!!!!!!
 
-void CTriac::setZero(byte power) {
-  if (power == PWR_OFF) {
+void CTriac::lock() { // recursive, public calls nest
+  xSemaphoreTakeRecursive(writeMutex, portMAX_DELAY);
+}
+
+void CTriac::unlock() {
+  xSemaphoreGiveRecursive(writeMutex);
+}
+
+void CTriac::setZero(bool active) {
+  if (!active) {
     zeroOff();
     if (lpCallback != NULL) {
       lpCallback(false);
@@ -132,15 +312,39 @@ void CTriac::setZero(byte power) {
 
 void CTriac::zeroOn() {
   if (!zeroState) {
+    pllReset();
+    captureData.valid = false;
+    captureData.latencyAv = 0;
+    captureData.latencyMax = 0;
+#if defined(ZERO_CAPTURE) && defined(SOC_MCPWM_SUPPORTED)
+    mcpwm_capture_config_t conf = {};
+    conf.cap_edge = MCPWM_POS_EDGE;
+    conf.cap_prescale = 1;
+    conf.capture_cb = isr_capture;
+    conf.user_data = NULL;
+    mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM_CAP_0, ZEROCROSS_PIN);
+    mcpwm_capture_enable_channel(MCPWM_UNIT_0, MCPWM_SELECT_CAP0, &conf);
+#else
+#if defined(ZERO_CAPTURE)
+    cpuMHz = getCpuFrequencyMhz();
+#endif
     attachInterrupt(digitalPinToInterrupt(ZEROCROSS_PIN), isr_ext, RISING);
+#endif
     zeroState = true;
   }
 }
 
 void CTriac::zeroOff() {
   if (zeroState) {
+#if defined(ZERO_CAPTURE) && defined(SOC_MCPWM_SUPPORTED)
+    mcpwm_capture_disable_channel(MCPWM_UNIT_0, MCPWM_SELECT_CAP0);
+#else
     detachInterrupt(digitalPinToInterrupt(ZEROCROSS_PIN));
+#endif
     zeroState = false;
+    portENTER_CRITICAL(&stateMux); // no zero crossing will take over a pending config
+    applyConfig();
+    portEXIT_CRITICAL(&stateMux);
   }
 }
 
@@ -162,83 +366,165 @@ void CTriac::testZeroCalibrated() {
   }
 }
 
-unsigned long CTriac::calcPowerMode(byte power) {
-  float freq = getFreq();
-  unsigned long ignTime = IGNITION_MAX;
-  if (freq > 0) {
-    ignTime = (unsigned long)round((acos(power/50.0 - 1.0) * 1000000.0) / (2*M_PI*freq));
+void CTriac::updateIgnitionTable() {
+  unsigned long zeroTime = getZeroTime();
+  CIgnition &table = tables[tableIndex];
+  if ((zeroTime >= ZERO_MIN) && (dimMode != burst)) { // burst mode has no ignition angle
+    if ((tableStale) || (table.getMode() != (byte)dimMode) || (table.getZeroTime() < ZERO_MIN) ||
+        (zeroTime > table.getZeroTime() + TABLE_DRIFT_US) || (zeroTime + TABLE_DRIFT_US < table.getZeroTime())) {
+      buildIgnitionTable(zeroTime);
+    }
   }
-  return ignTime;
 }
 
-unsigned long CTriac::calcTimedMode(byte power) {
-  unsigned long zeroTime = getZeroTime();
-  unsigned long ignTime = IGNITION_MAX;
-  if (zeroTime >= ZERO_MIN) {
-    ignTime = ((zeroTime*(PWR_ON-power)) / 100);
+void CTriac::buildIgnitionTable(unsigned long zeroTime) {
+  // built into the spare table without the lock, the engine task keeps reading the running one
+  long output[PWR_ON+1];
+  byte spare;
+  triacmode mode;
+  lock();
+  if (tableBuilding) { // in another task
+    unlock();
+    return;
   }
-  return ignTime;
+  tableBuilding = true;
+  tableStale = false;
+  spare = tableIndex ^ 1;
+  mode = dimMode;
+  unlock();
+  for (int i = PWR_OFF; i <= PWR_ON; i++) {
+    output[i] = lamp.getOutput(i);
+  }
+  tables[spare].build(zeroTime, (byte)mode, (mode == power), output);
+  lock();
+  tableIndex = spare;
+  tableBuilding = false;
+  unlock();
 }
 
-byte CTriac::calcFromPowerMode(unsigned long ignTime) {
-  float freq = getFreq();
-  return (byte)round((1.0 + cos(2.0*M_PI*freq*(ignTime/1000000.0))) * 50.0);
+unsigned short CTriac::calcFromIgnitionTable(unsigned long ignTime) { // with writeMutex held
+  CIgnition &table = tables[tableIndex];
+  if (table.getZeroTime() < ZERO_MIN) {
+    return LEVEL_OFF;
+  }
+  return table.getLevel(ignTime);
 }
 
-byte CTriac::calcFromTimedMode(unsigned long ignTime) {
+void CTriac::setIgniteTime(byte channel, unsigned long ignTime, unsigned short &level) {
   unsigned long zeroTime = getZeroTime();
-  return (byte)(PWR_ON - (ignTime*100 /zeroTime));
+  pulseWidth = zeroTime/100;
+  // check safety
+  if (ignTime > ZERO_MAX) {
+    level = LEVEL_OFF;
+  }
+  channelData[channel].igniteTime = safeIgniteTime(ignTime, zeroTime);
 }
 
-void CTriac::setIgniteTime(unsigned long ignTime, byte &power) {
-  portENTER_CRITICAL(&stateMux);
-  unsigned long zeroTime = getZeroTime();
-  triacData.igniteTime = ignTime;
-  triacData.pulseWidth = zeroTime/100;
-  // check safety
-  if (triacData.igniteTime > ZERO_MAX) {
-    if (&power != NULL) {
-      power = PWR_OFF;
-    }
-  } else if ((triacData.igniteTime + triacData.pulseWidth) > (zeroTime - SAFETY_TIME_US)) {
-    triacData.igniteTime -= SAFETY_TIME_US;
+unsigned long CTriac::safeIgniteTime(unsigned long ignTime, unsigned long zeroTime) {
+  if ((ignTime <= ZERO_MAX) && ((ignTime + pulseWidth) > (zeroTime - SAFETY_TIME_US))) {
+    ignTime -= SAFETY_TIME_US;
   }
-  portEXIT_CRITICAL(&stateMux);
+  return ignTime;
 }
 
-unsigned long CTriac::getIgniteTime() {
-  return triacData.igniteTime;
+unsigned long CTriac::calcIgniteTime(unsigned short level) { // with writeMutex held
+  CIgnition &table = tables[tableIndex];
+  if ((table.getZeroTime() < ZERO_MIN) || (table.getMode() != (byte)dimMode)) {
+    return IGNITION_MAX;
+  }
+  return table.getTime(level);
 }
 
-void CTriac::setState(byte power) {
-  portENTER_CRITICAL(&stateMux);
+unsigned long CTriac::getIgniteTime(byte channel) {
+  volatile triacconfig &cfg = configs[configIndex];
+  if (cfg.state[channel] == chdim) { // running ignition time, also while fading
+    return cfg.ignite[channel];
+  }
+  return channelData[channel].igniteTime;
+}
+
+void CTriac::setState(byte channel, unsigned short level) {
   if (triacData.state < zerouncalibrated) {
-    if (power == PWR_OFF) {
-      triacData.state = off;
-      digitalWrite(TRIGGER_PIN, LOW);
-    } else if (power == PWR_ON) {
-      triacData.state = on;
-      digitalWrite(TRIGGER_PIN, HIGH);
-    } else if (triacData.state > pulse) {
-      triacData.state = idle;
+    if (level == LEVEL_OFF) {
+      channelData[channel].state = choff;
+    } else if (level == LEVEL_ON) {
+      channelData[channel].state = chon;
+    } else if (dimMode == burst) {
+      channelData[channel].state = chburst;
+    } else {
+      channelData[channel].state = chdim;
     }
   } else {
-    digitalWrite(TRIGGER_PIN, LOW);
-  } 
-  portEXIT_CRITICAL(&stateMux);
+    channelData[channel].state = choff;
+  }
+  publishConfig();
 }
 
-unsigned long CTriac::getZeroTime() {
-  int i;
-  unsigned long sumMemory = 0;
-
-  if (triacData.movAvValid) {
-    portENTER_CRITICAL(&movAvMux);
-    for (i=0; i<MOVAV_WIDTH; i++) {
-      sumMemory += triacData.movAvMemory[i];
+void CTriac::publishConfig() {
+  // lock free towards the isr, which only swaps when configUpdate is set, writers hold writeMutex
+  eventlist list;
+  bool dimming = false;
+  list.count = 0;
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    if (channelData[ch].state == chdim) {
+      insertEvent(list, channelData[ch].igniteTime, ch, HIGH);
+      insertEvent(list, channelData[ch].igniteTime + pulseWidth, ch, LOW);
     }
-    portEXIT_CRITICAL(&movAvMux);
-  } else {
+    dimming |= (channelData[ch].state >= chdim);
+  }
+  configUpdate = false; // withdraw a pending config before writing it again
+  volatile triacconfig &cfg = configs[configIndex ^ 1];
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    cfg.state[ch] = channelData[ch].state;
+    cfg.ignite[ch] = channelData[ch].igniteTime;
+    cfg.burstLevel[ch] = channelData[ch].burstLevel;
+    cfg.fade[ch].seq = fade[ch].seq;
+    cfg.fade[ch].start = fade[ch].start;
+    cfg.fade[ch].end = fade[ch].end;
+    cfg.fade[ch].step = fade[ch].step;
+    cfg.fade[ch].curve = fade[ch].curve;
+  }
+  for (byte i = 0; i < list.count; i++) {
+    cfg.events.event[i].time = list.event[i].time;
+    cfg.events.event[i].channel = list.event[i].channel;
+    cfg.events.event[i].level = list.event[i].level;
+  }
+  cfg.events.count = list.count;
+  cfg.pulseWidth = pulseWidth;
+  cfg.dimming = dimming;
+  configUpdate = true;
+  if (!zeroState) { // no zero crossings, take over now
+    portENTER_CRITICAL(&stateMux);
+    applyConfig();
+    portEXIT_CRITICAL(&stateMux);
+  }
+}
+
+void CTriac::insertEvent(eventlist &list, unsigned long time, byte channel, byte level) {
+  byte i = list.count;
+  while ((i > 0) && (list.event[i-1].time > time)) {
+    list.event[i] = list.event[i-1];
+    i--;
+  }
+  list.event[i].time = time;
+  list.event[i].channel = channel;
+  list.event[i].level = level;
+  list.count++;
+}
+
+unsigned long CTriac::getZeroTime() {
+  unsigned long seq;
+  unsigned long sumMemory;
+  bool valid;
+
+  // seqlock, retry if isr_ext updated the sum while reading
+  do {
+    seq = triacData.movAvSeq;
+    valid = triacData.movAvValid;
+    sumMemory = triacData.movAvSum;
+  } while ((seq & 1) || (seq != triacData.movAvSeq));
+
+  if (!valid) {
     sumMemory = MOVAV_WIDTH; //prevent div 0 if not valid
   }
   return (sumMemory/MOVAV_WIDTH);
@@ -246,49 +532,405 @@ unsigned long CTriac::getZeroTime() {
 
 void CTriac::ClearMovAvFilter() {
   portENTER_CRITICAL(&movAvMux);
-  triacData.movAvMemory[MOVAV_WIDTH] = { 0 };
+  triacData.movAvSeq++;
+  for (int i=0; i<MOVAV_WIDTH; i++) {
+    triacData.movAvMemory[i] = 0;
+  }
+  triacData.movAvSum = 0;
   triacData.movAvCounter = 0;
   triacData.stabilizerCounter = 0;
   triacData.movAvValid = false;
+  triacData.movAvSeq++;
   portEXIT_CRITICAL(&movAvMux);
 }
 
+void CTriac::pllReset() {
+  portENTER_CRITICAL(&stateMux);
+  pllData.period = 0;
+  pllData.missed = 0;
+  pllData.rejected = 0;
+  pllData.skipped = 0;
+  pllData.lockCounter = 0;
+  pllData.locked = false;
+  pllData.flywheel = false;
+  portEXIT_CRITICAL(&stateMux);
+}
+
+bool IRAM_ATTR CTriac::pllUpdate(unsigned long stamp) {
+  long err;
+  long period = pllData.period >> PLL_FRAC;
+
+  pllData.skipped = 0;
+  if (pllData.period == 0) { // start from moving average
+    if (triacData.movAvValid) {
+      pllData.period = (long)((triacData.movAvSum << PLL_FRAC) / MOVAV_WIDTH);
+      pllData.nextZero = stamp + (pllData.period >> PLL_FRAC);
+    }
+    pllData.estZero = stamp;
+    return true;
+  }
+
+  err = (long)(stamp - pllData.nextZero);
+  while ((err > period/2) && (pllData.missed <= PLL_MISSED_MAX)) { // edges missed
+    pllData.nextZero += period;
+    err -= period;
+    pllData.skipped++;
+    pllData.missed++;
+  }
+  // both counters ride through PLL_MISSED_MAX edges and lose lock on the next one
+  if ((pllData.missed <= PLL_MISSED_MAX) && ((err > PLL_GLITCH_US) || (err < -PLL_GLITCH_US)) && (pllData.locked)) {
+    if (++pllData.rejected <= PLL_MISSED_MAX) { // glitch, ignore edge
+      pllData.glitches++;
+      return false;
+    }
+  }
+  if ((pllData.missed > PLL_MISSED_MAX) || (pllData.rejected > PLL_MISSED_MAX) || (err > PLL_GLITCH_US) || (err < -PLL_GLITCH_US)) {
+    // out of lock, restart tracking from this edge
+    pllData.locked = false;
+    pllData.lockCounter = 0;
+    pllData.missed = 0;
+    pllData.rejected = 0;
+    pllData.nextZero = stamp + period;
+    pllData.estZero = stamp;
+    return true;
+  }
+
+  // PI loop filter
+  pllData.missed = 0;
+  pllData.rejected = 0;
+  pllData.phaseError = err;
+  CDiag::record(CDiag::zerojitter, labs(err));
+  pllData.errorAv += (long)((labs(err) << PLL_FRAC) - pllData.errorAv) >> PLL_AV_SHIFT;
+  pllData.period += (err * (1L << PLL_FRAC)) >> PLL_KI_SHIFT; // err is signed, no left shift
+  pllData.period = constrain(pllData.period, (long)ZERO_MIN << PLL_FRAC, (long)ZERO_MAX << PLL_FRAC);
+  pllData.estZero = pllData.nextZero + (err >> PLL_KP_SHIFT);
+  pllData.nextZero = pllData.estZero + (pllData.period >> PLL_FRAC);
+
+  if ((err <= PLL_LOCK_US) && (err >= -PLL_LOCK_US)) {
+    if ((!pllData.locked) && (++pllData.lockCounter >= PLL_LOCK_NR)) {
+      pllData.locked = true;
+    }
+  } else if (!pllData.locked) {
+    pllData.lockCounter = 0;
+  }
+  return true;
+}
+
+void IRAM_ATTR CTriac::pllFlywheel() { // arm next ignition from prediction, rides through missed edges
+  unsigned long stamp = micros();
+  long period = pllData.period >> PLL_FRAC;
+
+  pllData.flyZero = pllData.nextZero;
+  if ((long)(stamp - pllData.nextZero) >= 0) { // predicted zero crossing passed
+    pllData.flyZero += period;
+    if ((long)(stamp - pllData.nextZero) > PLL_GLITCH_US) { // and no edge within window
+      pllData.nextZero += period;
+      if (++pllData.missed > PLL_MISSED_MAX) {
+        pllData.locked = false;
+        pllData.lockCounter = 0;
+        pllData.flywheel = false;
+        return;
+      }
+    }
+  }
+  pllData.flywheel = armEvents(pllData.flyZero, stamp);
+}
+
+void IRAM_ATTR CTriac::applyConfig() { // called from stateMux, at a zero crossing or with the zero cross isr detached
+  if (!configUpdate) {
+    return;
+  }
+  volatile triacconfig &prev = configs[configIndex];
+  configIndex ^= 1;
+  configUpdate = false;
+  volatile triacconfig &cfg = configs[configIndex];
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    if ((cfg.state[ch] != prev.state[ch]) && (cfg.state[ch] != chburst)) { // dimming starts low, burst is set by burstFire
+      setTrigger(ch, (cfg.state[ch] == chon) ? HIGH : LOW);
+    }
+  }
+  if (triacData.state < zerouncalibrated) {
+    if ((triacData.state == zero) && (cfg.events.count == 0)) { // armed timer has nothing left to do
+      triacData.state = idle;
+    }
+    if (!cfg.dimming) {
+      triacData.state = off;
+    } else if (triacData.state == off) {
+      triacData.state = idle;
+    }
+  }
+}
+
+void IRAM_ATTR CTriac::fadeStep() { // called from stateMux at zero crossing, before the event list is armed
+  volatile triacconfig &cfg = configs[configIndex];
+  bool rebuild = false;
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    volatile fadedata &fd = cfg.fade[ch];
+    if (fd.seq != channelData[ch].fadeSeq) { // new fade or fade stopped
+      channelData[ch].fadeSeq = fd.seq;
+      channelData[ch].fadePhase = 0;
+      channelData[ch].fading = (fd.step > 0);
+    }
+    if (channelData[ch].fading) {
+      channelData[ch].fadePhase += fd.step;
+      if (channelData[ch].fadePhase >= FADE_ONE) {
+        channelData[ch].fadePhase = FADE_ONE;
+        channelData[ch].fading = false;
+      }
+      long value = fd.start + (long)(((long long)(fd.end - fd.start) * fadeCurve(fd.curve, channelData[ch].fadePhase)) >> FADE_SHIFT); // 16 bit levels * Q15
+      if (cfg.state[ch] == chburst) {
+        cfg.burstLevel[ch] = (unsigned short)value;
+      } else if (cfg.state[ch] == chdim) {
+        cfg.ignite[ch] = (unsigned long)value;
+        rebuild = true;
+      }
+    }
+  }
+  if (rebuild) {
+    eventlist list;
+    list.count = 0;
+    for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+      if (cfg.state[ch] == chdim) {
+        insertEvent(list, cfg.ignite[ch], ch, HIGH);
+        insertEvent(list, cfg.ignite[ch] + cfg.pulseWidth, ch, LOW);
+      }
+    }
+    for (byte i = 0; i < list.count; i++) {
+      cfg.events.event[i].time = list.event[i].time;
+      cfg.events.event[i].channel = list.event[i].channel;
+      cfg.events.event[i].level = list.event[i].level;
+    }
+    cfg.events.count = list.count;
+  }
+}
+
+long IRAM_ATTR CTriac::fadeCurve(fadecurve curve, unsigned long phase) { // Q15 [0..1] for phase [0..FADE_ONE]
+  if (phase >= FADE_ONE) {
+    return CURVE_ONE;
+  }
+  if (curve == fqsine) {
+    return CCurves::quarter(phase >> (FADE_BITS - 16));
+  } else if (curve == fsine) {
+    return CCurves::ease(phase >> (FADE_BITS - 16));
+  }
+  return (long)(phase >> (FADE_BITS - CURVE_SHIFT));
+}
+
+void IRAM_ATTR CTriac::burstFire() { // conduct whole half cycles, switched at zero crossing only
+  volatile triacconfig &cfg = configs[configIndex];
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    if (cfg.state[ch] == chburst) {
+      channelData[ch].burstSum += cfg.burstLevel[ch];
+      if (channelData[ch].burstSum >= LEVEL_ON) {
+        channelData[ch].burstSum -= LEVEL_ON;
+        setTrigger(ch, HIGH);
+      } else {
+        setTrigger(ch, LOW);
+      }
+    }
+  }
+}
+
+bool IRAM_ATTR CTriac::armEvents(unsigned long zeroStamp, unsigned long stamp) {
+  volatile triacconfig &cfg = configs[configIndex];
+  if ((triacData.state >= off) || (cfg.events.count == 0)) {
+    return false;
+  }
+  triacData.eventZero = zeroStamp;
+#if defined(TRIAC_USE_RMT)
+  // delay and pulse width are timed by the rmt, no timer events pending
+  for (byte i = 0; i < cfg.events.count; i++) {
+    byte ch = cfg.events.event[i].channel;
+    if ((cfg.events.event[i].level == HIGH) && (cfg.state[ch] == chdim)) {
+      trigger.pulse(ch, getEventDelay(cfg.events.event[i].time, stamp), cfg.pulseWidth);
+    }
+  }
+  return false;
+#else
+  triacData.state = zero;
+  triacData.eventIndex = 0;
+  hwtimer.triggerTicks(CTriacTimer::ticks(getEventDelay(cfg.events.event[0].time, stamp)));
+  return true;
+#endif
+}
+
+void IRAM_ATTR CTriac::setTrigger(byte channel, byte level) {
+#if defined(TRIAC_USE_RMT)
+  trigger.setLevel(channel, level);
+#else
+  digitalWrite(triggerPins[channel], level);
+#endif
+}
+
+unsigned long IRAM_ATTR CTriac::getEventDelay(unsigned long time, unsigned long stamp) {
+  long delay = (long)(triacData.eventZero + time - stamp);
+  if (delay < 1) {
+    delay = 1;
+  }
+  return (unsigned long)delay;
+}
+
+void IRAM_ATTR CTriac::captureLatency(unsigned long latency) {
+  captureData.latencyAv += (long)((latency << PLL_FRAC) - captureData.latencyAv) >> PLL_AV_SHIFT;
+  if (latency > captureData.latencyMax) {
+    captureData.latencyMax = latency;
+  }
+  CDiag::record(CDiag::zerolatency, latency);
+}
+
 void IRAM_ATTR CTriac::isr_ext() {
-  zeroSample = micros() - triacData.zeroStamp;
+  unsigned long cycles = DIAG_CYCLES();
+  unsigned long stamp = micros();
+#if defined(ZERO_CAPTURE)
+  // cycle counter is taken first, time spent in here until micros() is removed from the stamp
+  unsigned long latency = (DIAG_CYCLES() - cycles) / cpuMHz;
+  captureLatency(latency);
+  zeroEdge(stamp - latency, stamp);
+#else
+  zeroEdge(stamp, stamp);
+#endif
+  CDiag::record(CDiag::extcycles, DIAG_CYCLES() - cycles);
+}
+
+#if defined(ZERO_CAPTURE) && defined(SOC_MCPWM_SUPPORTED)
+bool IRAM_ATTR CTriac::isr_capture(mcpwm_unit_t mcpwm, mcpwm_capture_channel_id_t cap, const cap_event_data_t *edata, void *arg) {
+  unsigned long cycles = DIAG_CYCLES();
+  unsigned long now = micros();
+  // capture timer runs from APB, put the captured edge on the micros() time line
+  if (!captureData.valid) {
+    captureData.stamp = now;
+    captureData.frac = 0;
+    captureData.valid = true;
+  } else {
+    unsigned long ticks = edata->cap_value - captureData.ticks + captureData.frac;
+    captureData.stamp += ticks / CAPTURE_TICKS_US;
+    captureData.frac = ticks % CAPTURE_TICKS_US;
+  }
+  captureData.ticks = edata->cap_value;
+  long latency = (long)(now - captureData.stamp);
+  if (latency < 0) { // first edge had more latency than this one, move time line to this edge
+    captureData.stamp = now;
+    captureData.frac = 0;
+    latency = 0;
+  }
+  captureLatency(latency);
+  zeroEdge(captureData.stamp, now);
+  CDiag::record(CDiag::extcycles, DIAG_CYCLES() - cycles);
+  return false;
+}
+#endif
+
+void IRAM_ATTR CTriac::zeroEdge(unsigned long stamp, unsigned long now) {
+  if (!pllUpdate(stamp)) {
+    return;
+  }
+  zeroSample = stamp - triacData.zeroStamp;
   if (zeroSample >= ZERO_MIN) {
     triacData.zeroStamp += zeroSample;
     if (zeroSample <= ZERO_MAX) {
-      portENTER_CRITICAL_ISR(&movAvMux);
-      triacData.movAvMemory[triacData.movAvCounter] = zeroSample;
-      if (triacData.movAvCounter < MOVAV_WIDTH-1) {
-        triacData.movAvCounter++;
-      } else {
-        triacData.movAvValid = true;
-        triacData.movAvCounter = 0;
-        triacData.stabilizerCounter++;
+      if (pllData.skipped == 0) {
+        triacData.movAvSeq++;
+        triacData.movAvSum += zeroSample - triacData.movAvMemory[triacData.movAvCounter];
+        triacData.movAvMemory[triacData.movAvCounter] = zeroSample;
+        if (triacData.movAvCounter < MOVAV_WIDTH-1) {
+          triacData.movAvCounter++;
+        } else {
+          triacData.movAvValid = true;
+          triacData.movAvCounter = 0;
+          triacData.stabilizerCounter++;
+        }
+        triacData.movAvSeq++;
+      }
+      portENTER_CRITICAL_ISR(&stateMux);
+      if ((triacData.state != zero) || (triacData.eventIndex == 0)) { // not while an event list is running
+        applyConfig();
+        fadeStep();
+      }
+      if (triacData.state < off) {
+        burstFire();
+      }
+      if (!pllData.locked) {
+        if (triacData.state == idle) {
+          armEvents(stamp, now);
+        }
+      } else if ((triacData.state == idle) ||
+                 ((triacData.state == zero) && (pllData.flywheel) && (triacData.eventIndex == 0) &&
+                  (labs((long)(pllData.flyZero - pllData.estZero)) < (pllData.period >> (PLL_FRAC+1))))) {
+        // schedule from filtered zero crossing instead of raw edge
+        pllData.flywheel = false;
+        armEvents(pllData.estZero, now);
       }
-      portEXIT_CRITICAL_ISR(&movAvMux);
-      if (triacData.state == idle) {
-        portENTER_CRITICAL_ISR(&stateMux);
-        triacData.state = zero;
-        hwtimer.trigger(triacData.igniteTime);
-        portEXIT_CRITICAL_ISR(&stateMux);
+#if defined(TRIAC_USE_RMT)
+      if (pllData.locked) { // watchdog, only fires if the next edge is missed
+        hwtimer.triggerTicks(CTriacTimer::ticks(pllData.nextZero + PLL_GLITCH_US - now));
+      }
+#endif
+      portEXIT_CRITICAL_ISR(&stateMux);
+      if (notifyTask) { // clock the waveform engine
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(notifyTask, &woken);
+        if (woken) {
+          portYIELD_FROM_ISR();
+        }
       }
     }
   }
 }
 
+#if defined(TRIAC_USE_RMT)
+void IRAM_ATTR CTriac::isr_timer() { // zero crossing edge missed, fire from prediction
+  unsigned long cycles = DIAG_CYCLES();
+  portENTER_CRITICAL_ISR(&stateMux);
+  if ((pllData.locked) && (triacData.state == idle)) {
+    unsigned long stamp = micros();
+    unsigned long zeroStamp = pllData.nextZero;
+    pllData.nextZero += pllData.period >> PLL_FRAC;
+    if (++pllData.missed > PLL_MISSED_MAX) {
+      pllData.locked = false;
+      pllData.lockCounter = 0;
+    } else {
+      applyConfig();
+      fadeStep();
+      armEvents(zeroStamp, stamp);
+      hwtimer.triggerTicks(CTriacTimer::ticks(pllData.nextZero + PLL_GLITCH_US - stamp));
+    }
+  }
+  portEXIT_CRITICAL_ISR(&stateMux);
+  CDiag::record(CDiag::timercycles, DIAG_CYCLES() - cycles);
+}
+#else
 void IRAM_ATTR CTriac::isr_timer() {
+  unsigned long cycles = DIAG_CYCLES();
   portENTER_CRITICAL_ISR(&stateMux);
   if (triacData.state == zero) {
-    digitalWrite(TRIGGER_PIN, HIGH);
-    triacData.state = pulse;
-    hwtimer.trigger(triacData.pulseWidth);
-  } else if (triacData.state == pulse) {
-    digitalWrite(TRIGGER_PIN, LOW);
-    triacData.state = idle;
+    volatile triacconfig &cfg = configs[configIndex];
+    unsigned long elapsed = micros() - triacData.eventZero;
+    byte i = triacData.eventIndex;
+    if (elapsed > cfg.events.event[i].time) {
+      CDiag::record(CDiag::triggerlate, elapsed - cfg.events.event[i].time);
+    } else {
+      CDiag::record(CDiag::triggerlate, 0);
+    }
+    do { // all events that are due, list is sorted
+      byte ch = cfg.events.event[i].channel;
+      if (cfg.state[ch] == chdim) {
+        setTrigger(ch, cfg.events.event[i].level);
+      }
+      i++;
+    } while ((i < cfg.events.count) && (cfg.events.event[i].time <= elapsed + EVENT_MERGE_US));
+    triacData.eventIndex = i;
+    if (i < cfg.events.count) {
+      hwtimer.triggerTicks(CTriacTimer::ticks(getEventDelay(cfg.events.event[i].time, micros())));
+    } else {
+      triacData.state = idle;
+      if (pllData.locked) {
+        pllFlywheel();
+      }
+    }
   }
   portEXIT_CRITICAL_ISR(&stateMux);
+  CDiag::record(CDiag::timercycles, DIAG_CYCLES() - cycles);
 }
+#endif
 
 CTriac triac;
@@ -0,0 +1,38 @@
+/* 
+ * IOTDimmer - Trigger
+ * Hardware generated triac trigger pulses
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Trigger_h
+#define Trigger_h
+
+#include "Arduino.h"
+
+#if defined(TRIAC_USE_RMT)
+#if defined(ARDUINO_ARCH_ESP32)
+#include "driver/rmt.h"
+#include "hal/rmt_ll.h" // inline register access, safe in the iram isr with the flash cache off
+
+#define TRG_CLK_DIV       80     // 80 MHz APB / 80 = 1 us per tick
+#define TRG_MAX_TICKS     32767  // 15 bit duration per level
+
+class CTrigger {
+public:
+  CTrigger(); // constructor
+  void init(byte channel, int pin);
+  void IRAM_ATTR setLevel(byte channel, byte level);
+  void IRAM_ATTR pulse(byte channel, unsigned long udelay, unsigned long uwidth);
+};
+
+extern CTrigger trigger;
+
+#else 
+  #error "RMT trigger pulses are only supported on boards with an ESP32 processor."
+#endif
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+/* 
+ * IOTDimmer - Trigger
+ * Hardware generated triac trigger pulses
+ * Hardware: Lolin S2 Mini
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "Trigger.h"
+
+#if defined(TRIAC_USE_RMT)
+
+CTrigger::CTrigger() { // constructor
+}
+
+void CTrigger::init(byte channel, int pin) {
+  // no driver install, the tx end interrupt is not routed to the cpu
+  rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, (rmt_channel_t)channel);
+  config.clk_div = TRG_CLK_DIV;
+  config.tx_config.idle_output_en = true;
+  config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+  rmt_config(&config);
+}
+
+// the driver functions live in flash and take a spinlock, the isr only uses the ll register
+// functions and writes the channel ram directly (rmt_config enabled apb access to it)
+
+void IRAM_ATTR CTrigger::setLevel(byte channel, byte level) { // idle output stays enabled
+  rmt_ll_tx_set_idle_level(&RMT, channel, (level == HIGH) ? 1 : 0);
+}
+
+void IRAM_ATTR CTrigger::pulse(byte channel, unsigned long udelay, unsigned long uwidth) {
+  rmt_item32_t item;
+  item.level0 = 0;
+  item.duration0 = (udelay < TRG_MAX_TICKS) ? udelay : TRG_MAX_TICKS;
+  item.level1 = 1;
+  item.duration1 = (uwidth < TRG_MAX_TICKS) ? uwidth : TRG_MAX_TICKS;
+  RMTMEM.chan[channel].data32[0].val = item.val; // whole words
+  RMTMEM.chan[channel].data32[1].val = 0; // end marker
+  rmt_ll_tx_reset_pointer(&RMT, channel);
+  rmt_ll_tx_start(&RMT, channel);
+}
+
+CTrigger trigger;
+
+#endif
@@ -14,19 +14,26 @@
 #define SEED_PIN            -1
 #endif
 
-#define MODE_TIMER          0
-#define EFFECT_TIMER        1
+#define WAVEFORM_TASK_PRIO  19   // above lwip (18) and the arduino loop (1), below the wifi driver (23)
+#define WAVEFORM_TASK_STACK 4096
+#define WAVEFORM_TIMEOUT_MS 20   // run without zero crossings (dimmer off or uncalibrated)
+#define EFFECT_LAYERS       3    // stacked effects, layer 0 is the effect from the settings
 
 class CWaveform {
 public:
   enum waveformmode {instant = 0, linear = 1, sine = 2, qsine = 3};
-  enum waveformeffect {enone = 0, eramp = 1, esine = 2, erandom = 3, einput = 4};
+  enum waveformeffect {enone = 0, eramp = 1, esine = 2, erandom = 3, einput = 4, ecandle = 5};
+  enum blendmode {badd = 0, bmultiply = 1, bmin = 2, bmax = 3};
   CWaveform(); // constructor
-  void init(void);
+  void init(byte ichannel);
+  static void startEngine();
   void handle(void);
   void setPower(byte ipower);
   byte getPower();
+  void setLevel(unsigned short ilevel);
+  unsigned short getLevel();
   void setInput(int iinput);
+  void streamInput(int iinput); // high rate sources, not logged
   int getInput();
   void setMode(byte imode);
   byte getMode();
@@ -36,39 +43,65 @@ public:
   void setEffect(byte ieffect);
   byte getEffect();
   waveformeffect getEffectEnum();
+  void setLayer(byte layer, byte ieffect, byte iblend, byte magnitude, unsigned short time);
+  byte getChannel();
+  void setScene(bool play);
+  bool getScene();
+  bool getCommanded(); // level set since boot (mode and effect are restored before any command)
 private:
-  void updateMode(byte ipower);
-  byte calcMode();
-  unsigned long getElapsedPercent();
-  byte calcModeLinear();
-  byte calcModeSine();
-  byte calcModeQsine();
+  struct effectlayer {       // resolved once when configured
+    waveformeffect effect;
+    blendmode blend;
+    short magnitude;         // [%]
+    unsigned long time;      // [ms] effect period, noise lattice step for candle
+    long gain;               // [Q16] input effect gain
+  };
+  struct layerstate {        // run by the engine
+    unsigned long start;     // [ms] start of effect
+    unsigned long cycle;     // effect periods passed
+    long value;              // [LEVEL_ON] random offset of this period
+  };
+  static CTriac::fadecurve getCurve(waveformmode imode);
+  void handleScene();
+  void updateMode(unsigned short ilevel);
   void calcEffPower();
-  unsigned long getEffectElapsedPercent();
-  byte calcEffRamp();
-  byte calcEffSine();
-  byte calcEffRandom();
-  byte calcEffInput();
-  bool effDo(short &pwr);
-  void effRange(short &pwr);
-  byte power;
-  byte effPower;
-  byte prevPower;
-  byte startPower;
+  void runLayers();
+  bool effActive();
+  unsigned long getEffectPhase(byte layer);
+  long calcLayer(byte layer);
+  long blendLayer(blendmode blend, long lvl, long delta);
+  void effRange(long &lvl);
+  unsigned short power;      // [LEVEL_ON] requested level
+  unsigned short effPower;   // [LEVEL_ON] level including effects
+  unsigned short startPower; // [LEVEL_ON] level at the start of a fade
   bool modeConvDone;
+  bool commanded;
   int effectInput;
   waveformmode mode;
-  waveformeffect effect;
+  effectlayer layers[EFFECT_LAYERS];    // configured by setEffect and setLayer
+  effectlayer runLayer[EFFECT_LAYERS];  // copy the engine runs, restarts on change
+  layerstate layerState[EFFECT_LAYERS];
+  unsigned long layerSeq;
+  unsigned long runSeq;
   byte triacMode;
-  static void timerCallback(TimerHandle_t xTimer);
-  TimerHandle_t modeTimer;
-  StaticTimer_t modeTimerBuffer;
-  static portMUX_TYPE mux;
-  TimerHandle_t effTimer;
-  StaticTimer_t effTimerBuffer;
-  static boolean doEffect;
+  byte channel;
+  CNoise rng;
+  uint32_t noiseSeed;
+  unsigned long modeStart;   // [ms] start of running fade
+  unsigned long modeTime;    // [ms] duration of running fade
+  bool scenePlay;
+  byte sceneIndex;           // next segment
+  unsigned short sceneLevel; // [LEVEL_ON] target of running segment
+  unsigned long sceneStart;  // [ms] start of running segment
+  unsigned long sceneTime;   // [ms] duration of running segment
+  static portMUX_TYPE layerMux;
+  static void engine(void *arg);
+  static TaskHandle_t engineTask;
+  static StaticTask_t engineTaskBuffer;
+  static StackType_t engineStack[WAVEFORM_TASK_STACK];
 };
 
-extern CWaveform waveform;
+extern CWaveform waveforms[TRIAC_CHANNELS];
+extern CWaveform &waveform; // channel 0
 
 #endif
@@ -7,57 +7,99 @@
  * Copyright: Ivo Helwegen
  */
 
-#include <math.h>
 #include "Waveform.h"
+#include "Curves.h"
+#include "Noise.h"
+#include "Scene.h"
+#include "Audio.h"
+#include "InputStream.h"
 
-portMUX_TYPE CWaveform::mux = portMUX_INITIALIZER_UNLOCKED;
-boolean CWaveform::doEffect = false;
+TaskHandle_t CWaveform::engineTask = NULL;
+StaticTask_t CWaveform::engineTaskBuffer;
+StackType_t CWaveform::engineStack[WAVEFORM_TASK_STACK];
+portMUX_TYPE CWaveform::layerMux = portMUX_INITIALIZER_UNLOCKED;
 
 CWaveform::CWaveform() { // constructor
-  power = PWR_OFF;
-  prevPower = power;
+  power = LEVEL_OFF;
+  commanded = false;
+  for (byte l = 0; l < EFFECT_LAYERS; l++) {
+    layers[l] = {enone, badd, 0, 0, 0};
+    runLayer[l] = layers[l];
+  }
+  layerSeq = 0;
+  runSeq = 0;
   triacMode = (byte)triac.timed;
+  channel = 0;
+  modeStart = 0;
+  modeTime = 0;
+  scenePlay = false;
+  sceneIndex = 0;
+  sceneLevel = LEVEL_OFF;
+  sceneStart = 0;
+  sceneTime = 0;
 }
 
-void CWaveform::init(void) {
-  power = PWR_OFF;
+void CWaveform::init(byte ichannel) {
+  channel = ichannel;
+  power = LEVEL_OFF;
   effectInput = 0;
   setMode(settings.getByte(settings.WaveMode));
   setEffect(settings.getByte(settings.WaveEffect));
-  effPower = PWR_OFF;
-  prevPower = PWR_OFF;
-  startPower = PWR_OFF;
+  effPower = LEVEL_OFF;
+  startPower = LEVEL_OFF;
   modeConvDone = true;
-  randomSeed(analogRead(SEED_PIN));
-  modeTimer = xTimerCreateStatic("", pdMS_TO_TICKS(settings.getShort(settings.WaveMode100Percent)), pdFALSE, (void *)MODE_TIMER, timerCallback, &modeTimerBuffer);
-  effTimer = xTimerCreateStatic("", pdMS_TO_TICKS(settings.getShort(settings.WaveEffectTime)), pdTRUE, (void *)EFFECT_TIMER, timerCallback, &effTimerBuffer);
+#if defined(NOISE_SEED)
+  noiseSeed = CNoise::hash(NOISE_SEED, channel);
+#else
+  noiseSeed = CNoise::hash(analogRead(SEED_PIN) ^ micros(), channel);
+#endif
+  rng.seed(noiseSeed);
+}
+
+void CWaveform::startEngine() {
+  // clocked by the zero crossings, on the core the triac isrs run on (see CTriac::publishConfig)
+  engineTask = xTaskCreateStaticPinnedToCore(engine, "waveform", WAVEFORM_TASK_STACK, NULL, WAVEFORM_TASK_PRIO, engineStack, &engineTaskBuffer, xPortGetCoreID());
+  triac.setNotify(engineTask);
 }
 
 void CWaveform::handle(void) {
+  if (scenePlay) {
+    handleScene();
+    return;
+  }
   // calc mode
-  byte calcPower;
   if (triac.getMode() != triacMode) {
     triacMode = triac.getMode();
-    if (effect == enone) {
-      setPower(triac.getPower());
+    if (!effActive()) {
+      power = triac.getLevel(channel);
     }
   }
   calcEffPower();
-  if (effPower != prevPower) {
-    calcPower = calcMode();
-    if (calcPower != prevPower) {
-      triac.setPower(calcPower);
-      prevPower = calcPower;
-    }
+  if ((!modeConvDone) && ((millis() - modeStart) >= modeTime)) { // fade done, set exact final power
+    modeConvDone = true;
+    triac.setLevel(effPower, channel);
   }
 }
 
 void CWaveform::setPower(byte ipower) {
   logger.printf("Power: " + String(ipower));
-  power = ipower;
+  scenePlay = false;
+  power = LEVEL_PERCENT(min(ipower, (byte)PWR_ON));
+  commanded = true;
 }
 
 byte CWaveform::getPower() {
+  return PERCENT_LEVEL(power);
+}
+
+void CWaveform::setLevel(unsigned short ilevel) {
+  logger.printf("Level: " + String(ilevel));
+  scenePlay = false;
+  power = ilevel;
+  commanded = true;
+}
+
+unsigned short CWaveform::getLevel() {
   return power;
 }
 
@@ -66,6 +108,10 @@ void CWaveform::setInput(int iinput) {
   effectInput = iinput;
 }
 
+void CWaveform::streamInput(int iinput) {
+  effectInput = iinput;
+}
+
 int CWaveform::getInput() {
   return effectInput;
 }
@@ -80,217 +126,252 @@ byte CWaveform::getMode() {
 }
 
 boolean CWaveform::getStatus() {
-  return getPower() > settings.getByte(settings.LevelOff);
+  return getPower() > settings.data().LevelOff;
 }
 
 CWaveform::waveformmode CWaveform::getModeEnum() {
   return mode;
 }
 
-void CWaveform::setEffect(byte ieffect) {
+void CWaveform::setEffect(byte ieffect) { // layer 0, parameters from the settings
   logger.printf(LOG_WAVEFORM, "Effect: " + String(ieffect));
-  if ((waveformeffect)ieffect != effect) {
-    if (((waveformeffect)ieffect != enone) && ((waveformeffect)ieffect != einput)) {
-      xTimerChangePeriod(effTimer, pdMS_TO_TICKS(settings.getShort(settings.WaveEffectTime)), portMAX_DELAY);      
-    } else {
-      xTimerStop(effTimer, portMAX_DELAY);
-    }
-  }
-  effect = (waveformeffect)ieffect;
+  effectlayer layer = {(waveformeffect)ieffect, badd, (short)settings.getByte(settings.WaveEffectMagnitude),
+                       settings.getShort(settings.WaveEffectTime), (long)(settings.getFloat(settings.WaveEffectGain)*65536)};
+  portENTER_CRITICAL(&layerMux);
+  layers[0] = layer;
+  layerSeq++; // engine restarts the effects
+  portEXIT_CRITICAL(&layerMux);
 }
 
 byte CWaveform::getEffect() {
-  return (byte)effect;
+  return (byte)layers[0].effect;
 }
 
 CWaveform::waveformeffect CWaveform::getEffectEnum() {
-  return effect;
+  return layers[0].effect;
 }
 
-// Privates !!!!!!!!!!!!!
-
-void CWaveform::updateMode(byte ipower) {
-  unsigned long modeTime = 0;
-  if (mode != instant) {
-    startPower = prevPower;
-    if (ipower < startPower) {
-      modeTime = ((unsigned long)(startPower - ipower) * settings.getShort(settings.WaveMode100Percent)) / 100;
-    } else {
-      modeTime = ((unsigned long)(ipower - startPower) * settings.getShort(settings.WaveMode100Percent)) / 100;
-    }
-    xTimerChangePeriod(modeTimer, pdMS_TO_TICKS(modeTime), portMAX_DELAY);
-    modeConvDone = false;
-  } else {
-    modeConvDone = true;
+void CWaveform::setLayer(byte layer, byte ieffect, byte iblend, byte magnitude, unsigned short time) {
+  logger.printf(LOG_WAVEFORM, "Layer " + String(layer) + ": " + String(ieffect) + ", " + String(iblend) + ", " + String(magnitude) + ", " + String(time));
+  if ((layer >= EFFECT_LAYERS) || (ieffect > (byte)ecandle) || (iblend > (byte)bmax)) {
+    return;
   }
+  effectlayer el = {(waveformeffect)ieffect, (blendmode)iblend, (short)min(magnitude, (byte)PWR_ON),
+                    time, (long)(settings.getFloat(settings.WaveEffectGain)*65536)};
+  portENTER_CRITICAL(&layerMux);
+  layers[layer] = el;
+  layerSeq++;
+  portEXIT_CRITICAL(&layerMux);
 }
 
-byte CWaveform::calcMode() {
-  byte ipower = PWR_OFF;
-  if (modeConvDone) {
-    ipower = effPower;
-  } else {
-    if (xTimerIsTimerActive(modeTimer) == pdFALSE) {
-      ipower = effPower;
-      modeConvDone = true;
-    } else {
-      switch (mode) {
-        case linear:
-          ipower = calcModeLinear();
-          break;
-        case sine:
-          ipower = calcModeSine();
-          break;
-        case qsine:
-          ipower = calcModeQsine();
-          break;
-        default:
-          ipower = effPower;
-      }
-    }
+byte CWaveform::getChannel() {
+  return channel;
+}
+
+void CWaveform::setScene(bool play) {
+  logger.printf(LOG_WAVEFORM, "Scene: " + String(play));
+  commanded = true;
+  if (play) {
+    sceneIndex = 0;
+    sceneLevel = effPower;
+    sceneStart = millis();
+    sceneTime = 0;
+    scenePlay = true; // restarts from the first segment
+  } else if (scenePlay) {
+    scenePlay = false; // hold the running segment target
+    power = effPower;
   }
-  return ipower;
 }
 
-unsigned long CWaveform::getElapsedPercent() {
-  return (100*(xTimerGetPeriod(modeTimer) - (xTimerGetExpiryTime(modeTimer) - xTaskGetTickCount())))/xTimerGetPeriod(modeTimer);
+bool CWaveform::getScene() {
+  return scenePlay;
 }
 
-byte CWaveform::calcModeLinear() {
-  byte ipower = PWR_OFF;
-  if (effPower < startPower) {
-    ipower = (byte)(startPower - (((startPower - effPower)*getElapsedPercent())/100));
-  } else {
-    ipower = (byte)(startPower + (((effPower - startPower)*getElapsedPercent())/100));
+bool CWaveform::getCommanded() {
+  return commanded;
+}
+
+// Privates !!!!!!!!!!!!!
+
+CTriac::fadecurve CWaveform::getCurve(waveformmode imode) {
+  CTriac::fadecurve curve = CTriac::flinear;
+  if (imode == sine) {
+    curve = CTriac::fsine;
+  } else if (imode == qsine) {
+    curve = CTriac::fqsine;
   }
-  return ipower;
+  return curve;
 }
 
-byte CWaveform::calcModeSine()  {
-  byte ipower = PWR_OFF;
-  //(1+/sin(2*PI*t/2*T-PI/4))/2 = (1+sin(PI*t/T-PI/4))/2;
-  if (effPower < startPower) {
-    ipower = (byte)(startPower - round((startPower - effPower)*(1+sin(M_PI*getElapsedPercent()/100-(M_PI/4)))/2));
+void CWaveform::handleScene() { // segment boundaries only, the triac isr ramps the segment
+  CScene::segment seg;
+  if ((millis() - sceneStart) < sceneTime) {
+    return;
+  }
+  if ((sceneLevel == LEVEL_OFF) || (sceneLevel == LEVEL_ON)) { // fades end in the dimmable range
+    triac.setLevel(sceneLevel, channel);
+  }
+  if (sceneIndex >= scene.getCount()) {
+    if ((!scene.getLoop()) || (scene.getCount() == 0)) {
+      logger.printf(LOG_WAVEFORM, "Scene done");
+      scenePlay = false; // hold the last level
+      power = sceneLevel;
+      return;
+    }
+    sceneIndex = 0;
+  }
+  scene.getSegment(sceneIndex++, seg);
+  sceneStart += sceneTime; // segments follow each other without drift
+  sceneTime = seg.duration;
+  sceneLevel = LEVEL_PERCENT(seg.level);
+  power = sceneLevel;
+  effPower = sceneLevel;
+  modeConvDone = true;
+  if ((seg.curve == instant) || (seg.duration == 0)) {
+    triac.setLevel(sceneLevel, channel);
   } else {
-    ipower = (byte)(startPower + round((effPower - startPower)*(1+sin(M_PI*getElapsedPercent()/100-(M_PI/4)))/2));
+    triac.setFade(sceneLevel, seg.duration, getCurve((waveformmode)seg.curve), channel);
   }
-  return ipower;
 }
 
-byte CWaveform::calcModeQsine() {
-  byte ipower = PWR_OFF;
-  //sin(2*PI*t/4*T) = sin(PI*t/2*T);
-  if (effPower < startPower) {
-    ipower = (byte)(startPower - round((startPower - effPower)*sin(M_PI*getElapsedPercent()/200)));
+void CWaveform::updateMode(unsigned short ilevel) {
+  if (mode != instant) { // one fade descriptor per change, ramped by the triac isr every half cycle
+    CTriac::fadecurve curve = getCurve(mode);
+    startPower = triac.getLevel(channel);
+    if (ilevel < startPower) {
+      modeTime = ((unsigned long)(startPower - ilevel) * settings.data().WaveMode100Percent) / LEVEL_ON;
+    } else {
+      modeTime = ((unsigned long)(ilevel - startPower) * settings.data().WaveMode100Percent) / LEVEL_ON;
+    }
+    modeStart = millis();
+    modeConvDone = false;
+    triac.setFade(ilevel, modeTime, curve, channel);
   } else {
-    ipower = (byte)(startPower + round((effPower - startPower)*sin(M_PI*getElapsedPercent()/200)));
+    modeConvDone = true;
+    triac.setLevel(ilevel, channel);
   }
-  return ipower;
 }
 
 void CWaveform::calcEffPower() {
-  byte ieffPower = PWR_OFF;
-  switch (effect) {
-    case eramp:
-      ieffPower =  calcEffRamp();
-      break;
-    case esine:
-      ieffPower =  calcEffSine();
-      break;
-    case erandom:
-      ieffPower =  calcEffRandom();
-      break;
-    case einput:
-      ieffPower =  calcEffInput();
-      break;
-    default:
-      ieffPower = power;
+  long lvl = power;
+  runLayers();
+  if (effActive() && (power != LEVEL_OFF) && (power != LEVEL_ON)) { // effects only on dimmed levels
+    for (byte l = 0; l < EFFECT_LAYERS; l++) {
+      if (runLayer[l].effect != enone) {
+        lvl = blendLayer(runLayer[l].blend, lvl, calcLayer(l));
+      }
+    }
+    effRange(lvl);
   }
-  if (ieffPower != effPower) {
-    updateMode(ieffPower);
-    effPower = ieffPower;
+  if ((unsigned short)lvl != effPower) {
+    updateMode((unsigned short)lvl);
+    effPower = (unsigned short)lvl;
   }
 }
 
-unsigned long CWaveform::getEffectElapsedPercent() {
-  return (100*(xTimerGetPeriod(effTimer) - (xTimerGetExpiryTime(effTimer) - xTaskGetTickCount())))/xTimerGetPeriod(effTimer);
+void CWaveform::runLayers() {
+  if (runSeq == layerSeq) {
+    return;
+  }
+  portENTER_CRITICAL(&layerMux);
+  for (byte l = 0; l < EFFECT_LAYERS; l++) {
+    runLayer[l] = layers[l];
+  }
+  runSeq = layerSeq;
+  portEXIT_CRITICAL(&layerMux);
+  for (byte l = 0; l < EFFECT_LAYERS; l++) {
+    layerState[l].start = millis();
+    layerState[l].cycle = (unsigned long)-1; // new random value in the first period
+    layerState[l].value = 0;
+  }
 }
 
-byte CWaveform::calcEffRamp() {
-  short pwr = PWR_OFF;
-  byte effectMagnitude = settings.getByte(settings.WaveEffectMagnitude);
-  unsigned short effectTime = settings.getShort(settings.WaveEffectTime);
-  if (effDo(pwr)) {
-    unsigned long elapsedPercent = getEffectElapsedPercent();
-    if (elapsedPercent < 50) { //positive ramp
-      pwr = power - effectMagnitude + (((2*effectMagnitude)*elapsedPercent)/50);
-    } else { //negative ramp
-      pwr = power + effectMagnitude - (((2*effectMagnitude)*(elapsedPercent - 50))/50);
+bool CWaveform::effActive() {
+  for (byte l = 0; l < EFFECT_LAYERS; l++) {
+    if (runLayer[l].effect != enone) {
+      return true;
     }
-    effRange(pwr);
   }
-  return (byte)pwr;
+  return false;
 }
 
-byte CWaveform::calcEffSine() {
-  short pwr = PWR_OFF;
-  if (effDo(pwr)) {
-    pwr = power + round((settings.getByte(settings.WaveEffectMagnitude))*sin(2*M_PI*getEffectElapsedPercent()/100));
-    effRange(pwr);
-  }
-  return (byte)pwr;
-}
-
-byte CWaveform::calcEffRandom() {
-  short pwr = PWR_OFF;
-  byte effectMagnitude = settings.getByte(settings.WaveEffectMagnitude);
-  if (effDo(pwr)) {
-    if (doEffect) {
-      portENTER_CRITICAL(&mux);
-      doEffect = false;
-      portEXIT_CRITICAL(&mux);
-      pwr = random(power - effectMagnitude, power + effectMagnitude);
-      effRange(pwr);
-    } else {
-      pwr = effPower;
-    }
+unsigned long CWaveform::getEffectPhase(byte layer) { // [PHASE_ONE] elapsed part of effect period
+  unsigned long effectTime = runLayer[layer].time;
+  if (effectTime == 0) {
+    return 0;
   }
-  return (byte)pwr;
+  return (PHASE_ONE*((millis() - layerState[layer].start) % effectTime))/effectTime;
 }
 
-byte CWaveform::calcEffInput() {
-  short pwr = PWR_OFF;
-  if (effDo(pwr)) {
-    pwr = power + (short)round(effectInput*settings.getFloat(settings.WaveEffectGain));
-    effRange(pwr);
+long CWaveform::calcLayer(byte layer) { // [LEVEL_ON] offset of the layer
+  effectlayer &el = runLayer[layer];
+  layerstate &ls = layerState[layer];
+  long magnitude = LEVEL_PERCENT(el.magnitude);
+
+  switch (el.effect) {
+    case eramp: {
+      unsigned long phase = getEffectPhase(layer);
+      if (phase < PHASE_ONE/2) { //positive ramp
+        return -magnitude + (long)(((2*(long long)magnitude)*phase)/(PHASE_ONE/2));
+      } //negative ramp
+      return magnitude - (long)(((2*(long long)magnitude)*(phase - PHASE_ONE/2))/(PHASE_ONE/2));
+    }
+    case esine:
+      return (magnitude*CCurves::sine(getEffectPhase(layer)) + CURVE_ONE/2) >> CURVE_SHIFT;
+    case erandom: {
+      unsigned long cycle = (el.time > 0) ? (millis() - ls.start)/el.time : 0;
+      if (cycle != ls.cycle) { // new value every effect period
+        ls.cycle = cycle;
+        ls.value = rng.range(-magnitude, magnitude);
+      }
+      return ls.value;
+    }
+    case einput: { // gain is [%] per input unit
+      long long delta = ((long long)effectInput*el.gain*LEVEL_ON/PWR_ON + 32768) >> 16;
+      return (long)constrain(delta, -(long long)LEVEL_ON, (long long)LEVEL_ON);
+    }
+    case ecandle: { // smooth noise every half cycle, dips below the level by up to magnitude
+      unsigned long long pos = (el.time > 0) ? ((unsigned long long)(millis() - ls.start)*NOISE_ONE)/el.time : 0;
+      long noise = CNoise::candle(noiseSeed + layer, pos);
+      return -(long)(((long long)magnitude*(CURVE_ONE - noise)) >> (CURVE_SHIFT + 1));
+    }
+    default:
+      return 0;
   }
-  return (byte)pwr;
 }
 
-bool CWaveform::effDo(short &pwr) {
-  bool val = true;
-  if ((power == PWR_OFF) || (power == PWR_ON)) {
-    pwr = power;
-    val = false;
+long CWaveform::blendLayer(blendmode blend, long lvl, long delta) {
+  switch (blend) {
+    case bmultiply: // scale the level below by (100 % + offset)
+      return (long)(((long long)lvl*((long)LEVEL_ON + delta))/LEVEL_ON);
+    case bmin:
+      return min(lvl, (long)power + delta);
+    case bmax:
+      return max(lvl, (long)power + delta);
+    default:
+      return lvl + delta;
   }
-  return val;
 }
 
-void CWaveform::effRange(short &pwr) {
-  if (pwr >= PWR_ON) {
-    pwr = PWR_ON-1;
+void CWaveform::effRange(long &lvl) {
+  if (lvl > LEVEL_DIM_MAX) {
+    lvl = LEVEL_DIM_MAX;
   }
-  if (pwr <= PWR_OFF) {
-    pwr = PWR_OFF+1;
+  if (lvl < LEVEL_DIM_MIN) {
+    lvl = LEVEL_DIM_MIN;
   }
 }
 
-void CWaveform::timerCallback(TimerHandle_t xTimer) {
-  if ((uint32_t)pvTimerGetTimerID(xTimer) == EFFECT_TIMER) {
-    portENTER_CRITICAL(&mux);
-    doEffect = true;
-    portEXIT_CRITICAL(&mux);
+void CWaveform::engine(void *arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WAVEFORM_TIMEOUT_MS)); // every half cycle
+    audio.handle();
+    inputStream.play();
+    for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+      waveforms[ch].handle();
+    }
   }
 }
 
-CWaveform waveform;
+CWaveform waveforms[TRIAC_CHANNELS];
+CWaveform &waveform = waveforms[0];
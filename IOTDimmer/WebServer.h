@@ -25,6 +25,7 @@
 #define CTRLMODE   0
 #define CTRLEFFECT 1
 #define CTRLINPUT  2
+#define CTRLLAYER  3
 
 class cWebServer {
   public:
@@ -47,7 +48,10 @@ class cWebServer {
     static String getMode();
     static String getEffect();
     static String getTimeStatus();
+    static byte getChannel();
     static void handleHomeUpdate();
+    static void handleDiag();
+    static void handleScene();
     static void handleDimmerCommand();
     static void handleDimmerCtrl();
     static void handleWifiLoad();
@@ -29,6 +29,8 @@ void cWebServer::init() {
   server.on("/fwlink", handleRoot);  //Microsoft captive portal. Maybe not needed. Might be handled by notFound handler.
   server.on("/menuload", handleMenuLoad);
   server.on("/homeupdate", handleHomeUpdate);
+  server.on("/diag", handleDiag);
+  server.on("/scene", handleScene);
   server.on("/dimmercommand", handleDimmerCommand);
   server.on("/dimmerctrl", handleDimmerCtrl);
   server.on("/wifiload", handleWifiLoad);
@@ -251,6 +253,9 @@ String cWebServer::getEffect() {
     case waveform.einput:
       effect = "Input";
       break;
+    case waveform.ecandle:
+      effect = "Candle";
+      break;
   }
   return effect;
 }
@@ -265,33 +270,74 @@ String cWebServer::getTimeStatus() {
   return status;
 }
 
+byte cWebServer::getChannel() { // optional channel argument, default channel 0
+  byte channel = (byte)server.arg("ch").toInt();
+  if (channel >= TRIAC_CHANNELS) {
+    channel = 0;
+  }
+  return channel;
+}
+
 void cWebServer::handleHomeUpdate() {
   JSON jString;
+  CWaveform &wf = waveforms[getChannel()];
   jString.AddItem("time", Clock.getFormattedDate() + " " + Clock.getFormattedTime());
   jString.AddItem("timestatus", getTimeStatus());  
   jString.AddItem("mqttstatus", getMqttStatus((boolean)settings.getByte(settings.UseMqtt)));
   jString.AddItem("mainsfreq", String(triac.getFreq()));
-  jString.AddItem("level", waveform.getPower());
-  jString.AddItem("waveformmode", waveform.getMode());
-  jString.AddItem("effect", waveform.getEffect());
-  jString.AddItem("effectinput", waveform.getInput());
+  jString.AddItem("plllocked", triac.getLocked());
+  jString.AddItem("phaseerror", triac.getPhaseError());
+  jString.AddItem("zerolatency", triac.getZeroLatency());
+  jString.AddItem("zerolatencymax", (int)triac.getZeroLatencyMax());
+  jString.AddItem("level", wf.getPower());
+  jString.AddItem("waveformmode", wf.getMode());
+  jString.AddItem("effect", wf.getEffect());
+  jString.AddItem("effectinput", wf.getInput());
+  jString.AddItem("audiolevel", (int)audio.getLevel());
+  jString.AddItem("streamlost", (int)inputStream.getLost());
+  jString.AddItem("streamlate", (int)inputStream.getLate());
+  jString.AddItem("scene", wf.getScene());
+  jString.AddItem("channels", TRIAC_CHANNELS);
   server.send(200, "text/plane", jString.GetJson());
 }
 
+void cWebServer::handleDiag() {
+  if (server.hasArg("reset")) {
+    logger.printf(LOG_WEBSERVER, "Diagnostics reset");
+    diag.reset();
+  }
+  server.send(200, "text/plane", diag.getJson());
+}
+
+void cWebServer::handleScene() {
+  if (server.hasArg("data")) {
+    logger.printf(LOG_WEBSERVER, "Scene upload");
+    if (!scene.loadHex(server.arg("data"))) {
+      server.send(400, "text/plane", "Invalid scene");
+      return;
+    }
+  }
+  if (server.hasArg("play")) {
+    waveforms[getChannel()].setScene((bool)server.arg("play").toInt());
+  }
+  server.send(200, "text/plane", scene.getJson());
+}
+
 void cWebServer::handleDimmerCommand() {
   short Cmd = (short)server.arg("cmd").toInt();
+  CWaveform &wf = waveforms[getChannel()];
   if (Cmd == -1) { // Off command
     logger.printf(LOG_WEBSERVER, "Dimmer Command: OFF");
-    waveform.setPower(settings.getByte(settings.LevelOff));
+    wf.setPower(settings.getByte(settings.LevelOff));
   } else if (Cmd == 101) { // On command
     logger.printf(LOG_WEBSERVER, "Dimmer Command: ON");
-    waveform.setPower(settings.getByte(settings.LevelOn));
+    wf.setPower(settings.getByte(settings.LevelOn));
   } else if (Cmd == 110) { // Lounge command
     logger.printf(LOG_WEBSERVER, "Dimmer Command: LOUNGE");
-    waveform.setPower(settings.getByte(settings.LevelLounge));
+    wf.setPower(settings.getByte(settings.LevelLounge));
   } else { // directly set power
     logger.printf(LOG_WEBSERVER, "Dimmer Command: " + String(Cmd));
-    waveform.setPower((byte)Cmd);
+    wf.setPower((byte)Cmd);
   }
   LED.Command();
   server.send(200, "text/plane", "Ok");
@@ -300,12 +346,16 @@ void cWebServer::handleDimmerCommand() {
 void cWebServer::handleDimmerCtrl() {
   byte Type = (byte)server.arg("type").toInt();
   int Ctrl = (int)server.arg("ctrl").toInt();
+  CWaveform &wf = waveforms[getChannel()];
   if (Type == CTRLMODE) {
-    waveform.setMode((byte)Ctrl);
+    wf.setMode((byte)Ctrl);
   } else if (Type == CTRLEFFECT) {
-    waveform.setEffect((byte)Ctrl);
+    wf.setEffect((byte)Ctrl);
   } else if (Type == CTRLINPUT) {
-    waveform.setInput(Ctrl);
+    wf.setInput(Ctrl);
+  } else if (Type == CTRLLAYER) {
+    wf.setLayer((byte)server.arg("layer").toInt(), (byte)Ctrl, (byte)server.arg("blend").toInt(),
+                (byte)server.arg("magnitude").toInt(), (unsigned short)server.arg("time").toInt());
   } 
   server.send(200, "text/plane", "Ok");
 }
@@ -480,6 +530,10 @@ void cWebServer::handleDimmerLoad() {
   jString.AddItem("leveloff", settings.getByte(settings.LevelOff));
   jString.AddItem("levelon", settings.getByte(settings.LevelOn));
   jString.AddItem("levellounge", settings.getByte(settings.LevelLounge));
+  jString.AddItem("lampcurve", settings.getByte(settings.LampCurve));
+  jString.AddItem("lampmin", settings.getByte(settings.LampMin));
+  jString.AddItem("lampmax", settings.getByte(settings.LampMax));
+  jString.AddItem("lamppoints", lamp.getPoints());
 
   server.send(200, "text/plane", jString.GetJson());
 }
@@ -509,7 +563,21 @@ void cWebServer::handleDimmerSave() {
   settings.set(settings.LevelOn, bval);
   bval = (byte)server.arg("levellounge").toInt();
   settings.set(settings.LevelLounge, bval);
+  bval = (byte)server.arg("lampcurve").toInt();
+  settings.set(settings.LampCurve, bval);
+  bval = (byte)server.arg("lampmin").toInt();
+  settings.set(settings.LampMin, bval);
+  bval = (byte)server.arg("lampmax").toInt();
+  settings.set(settings.LampMax, bval);
+  byte points[LAMP_POINTS];
+  if (CLamp::setPoints(server.arg("lamppoints"), points)) {
+    settings.set(settings.LampPoints, (char *)points);
+  }
   settings.update();
+  lamp.update();
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) { // resolve the new effect parameters
+    waveforms[ch].setEffect(waveforms[ch].getEffect());
+  }
   server.sendHeader("Location", "dimmer", true);
   server.send(302, "text/plain", "");    // Empty content inhibits Content-length header so we have to close the socket ourselves.
   server.client().stop(); // Stop is needed because we sent no content length
@@ -610,6 +678,7 @@ void cWebServer::handleMqttSave() {
   sval2 = mqtt.fixTopic(sval);
   settings.set(settings.haTopic, sval2);
   settings.update();
+  mqtt.buildTopics();
   server.sendHeader("Location", "mqtt", true);
   server.send(302, "text/plain", "");    // Empty content inhibits Content-length header so we have to close the socket ourselves.
   server.client().stop(); // Stop is needed because we sent no content length
@@ -640,6 +709,7 @@ void cWebServer::handleDoReboot() {
   Page = String(webRebooting);
   server.send(200, "text/html", Page);    
   server.client().stop(); // Stop is needed because we sent no content length
+  settings.flush();
   ESP.restart();
 }
 
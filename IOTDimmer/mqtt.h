@@ -10,6 +10,7 @@
 #define MQTT_h
 
 #include <PubSubClient.h>
+#include <esp_heap_caps.h>
 
 #define MQTT_SERVER "mqtt.broker.com"
 #define MQTT_PORT 1883
@@ -20,13 +21,18 @@
 #define CONNECT_TIMER       0
 #define PUBLISH_TIMER       1
 
+#define MQTT_TOPIC_SIZE     (sizeof(settingsdata::mainTopic) + 24) // maintopic/ch<n>/tag
+#define MQTT_VALUE_SIZE     12
+#define MQTT_DIAG_SIZE      256 // {"count":n,"max":n,"buckets":[16 x n]}
+#define DIAG_TOPICS         (CDiag::histnr + 1) // histograms and publishalloc
+
 typedef struct { 
   String tag;
   String description;
 } topics;
 
 typedef struct { 
-  String value;
+  char value[MQTT_VALUE_SIZE];
   unsigned long updateCounter;
 } valueMem;
 
@@ -48,7 +54,7 @@ const char freq_status_cmt[] = "publish: current line frequency [Hz]";
 const char mode_status_cmt[] = "publish: current mode status [0=inst, 1=lin, 2=sin, 3=qsin]";
 const char effect_status_cmt[] = "publish: current effect status [0=none, 1=ramp, 2=sin, 3=rnd, 4=inp]";
 
-const topics PublishTopics[] {
+const topics PublishTopics[] { // same order as publishid
   {light_status, light_status_cmt},
   {dim_status, dim_status_cmt},
   {freq_status, freq_status_cmt},
@@ -56,6 +62,15 @@ const topics PublishTopics[] {
   {effect_status, effect_status_cmt}
 };
 
+enum publishid {pub_light = 0, pub_dim = 1, pub_freq = 2, pub_mode = 3, pub_effect = 4, PUBLISH_COUNT = 5};
+
+const char channel_prefix[] = "ch"; // channel n > 0 topics: maintopic/ch<n>/tag
+const char publish_alloc[] = "publishalloc"; // maintopic/diag/publishalloc, should stay 0
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+extern "C" void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps); // counts allocations by the publish pass
+#endif
+
 const char dim_offon[] = "offon";
 const char dim_off[] = "off";
 const char dim_on[] = "on";
@@ -64,6 +79,9 @@ const char dim_dim[] = "dim";
 const char dim_mode[] = "mode";
 const char dim_effect[] = "effect";
 const char dim_input[] = "input";
+const char dim_layer[] = "layer";
+const char dim_scene[] = "scene";
+const char dim_sceneplay[] = "sceneplay";
 const char dim_offon_cmt[] = "subscribe: switch dimmer off (0) or on (1) [off/ on, false/ true, 0/ 1]";
 const char dim_off_cmt[] = "subscribe: switch dimmer off [off/ on, false/ true, 0/ 1]";
 const char dim_on_cmt[] = "subscribe: switch dimmer on [off/ on, false/ true, 0/ 1]";
@@ -72,6 +90,9 @@ const char dim_dim_cmt[] = "subscribe: set dimmer power [0-100 %]";
 const char dim_mode_cmt[] = "subscribe: set dimmer mode [0..3]";
 const char dim_effect_cmt[] = "subscribe: set dimmer effect [0..4]";
 const char dim_input_cmt[] = "subscribe: set dimmer input effect signal [integer]";
+const char dim_layer_cmt[] = "subscribe: set effect layer [layer,effect,blend,magnitude,time] (blend 0 add, 1 multiply, 2 min, 3 max)";
+const char dim_scene_cmt[] = "subscribe: upload scene timeline [binary scene format]";
+const char dim_sceneplay_cmt[] = "subscribe: stop (0) or start (1) scene [off/ on, false/ true, 0/ 1]";
 
 //const String dim_modes[] = {"Instant", "Linear", "Sine", "Qsine"};
 
@@ -83,7 +104,10 @@ const topics SubscribeTopics[] {
   {dim_dim, dim_dim_cmt},
   {dim_mode, dim_mode_cmt},
   {dim_effect, dim_effect_cmt},
-  {dim_input, dim_input_cmt}
+  {dim_input, dim_input_cmt},
+  {dim_layer, dim_layer_cmt},
+  {dim_scene, dim_scene_cmt},
+  {dim_sceneplay, dim_sceneplay_cmt}
 };
 
 const char dev_mf[] = "IOTControl";
@@ -106,8 +130,10 @@ class cMqtt {
     void handle();
     void update();
     String fixTopic(String topic);
-    String getValue(String tag);
-    String buildTopic(String tag);
+    String getValue(String tag, byte channel = 0);
+    String buildTopic(String tag, byte channel = 0);
+    void buildTopics();
+    unsigned long getAllocations();
     String clientId;
     boolean connected;
   private:
@@ -116,19 +142,41 @@ class cMqtt {
                    offline = 2};
     static void callback(char* topic, byte* payload, unsigned int length);
     void sendStatus();
+    void pollValues(bool *publish);
+    void publishValue(int index);
+    void logValue(int index);
+    void startAllocations();
+    unsigned long stopAllocations();
+    void formatValue(byte id, byte channel, char *value);
+    static char *formatFixed(char *text, unsigned long value, byte decimals);
+    static char *formatHistogram(char *text, byte id);
+    void sendDiag();
     void isConnected();
     void reconnect();
     void homeAssistantDiscovery();
     static String getTag(String topic);
     static String getMain(String topic);
+    static byte getChannel(String topic, String tag);
     static String bp2string(byte *payload, unsigned int length);
     static boolean getBoolean(String payload);
-    static byte getPercentage(String payload);
+    static unsigned short getLevel(String payload);
     static byte getByte(String payload);
     static int getInt(String payload);
+    static bool getList(String payload, long *values, byte n);
     String joinTopic(String topic, String tag);
     String us(String tag);
-    valueMem *publishMem;
+    valueMem publishMem[PUBLISH_COUNT*TRIAC_CHANNELS];
+    char topicTable[PUBLISH_COUNT*TRIAC_CHANNELS][MQTT_TOPIC_SIZE]; // built once, empty if not published
+    char diagTopics[DIAG_TOPICS][MQTT_TOPIC_SIZE];
+    unsigned long allocations; // heap allocations (or bytes without heap hooks) by steady state publish passes
+#ifdef CONFIG_HEAP_USE_HOOKS
+    friend void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps);
+    static volatile TaskHandle_t allocTask; // task of the measured pass, NULL if not measuring
+    static volatile unsigned long allocCount;
+#else
+    size_t allocFree;
+#endif
+    unsigned long diagCounter;
     boolean reconnect_wait;
     static void timerCallback(TimerHandle_t xTimer);
     TimerHandle_t conTimer;
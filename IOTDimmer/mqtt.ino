@@ -13,19 +13,35 @@ portMUX_TYPE cMqtt::mux = portMUX_INITIALIZER_UNLOCKED;
 boolean cMqtt::doPub = false;
 cMqtt::hastatus cMqtt::statusHa = cMqtt::unknown;
 boolean cMqtt::discoUpdate = false;
+#ifdef CONFIG_HEAP_USE_HOOKS
+volatile TaskHandle_t cMqtt::allocTask = NULL;
+volatile unsigned long cMqtt::allocCount = 0;
+
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) { // every allocation, any task
+  if ((cMqtt::allocTask != NULL) && (xTaskGetCurrentTaskHandle() == cMqtt::allocTask)) {
+    cMqtt::allocCount++;
+  }
+}
+#endif
 
 WiFiClient espClient;
 PubSubClient client(espClient);
 
+static_assert(sizeof(PublishTopics) / sizeof(topics) == PUBLISH_COUNT, "PublishTopics and publishid differ");
+
 cMqtt::cMqtt() { // constructor
-  int publishLen = (sizeof(PublishTopics) / sizeof(topics));
-  publishMem = new valueMem[publishLen];
-  for (int i = 0; i < publishLen; i++) {
-    publishMem[i].value = "";
+  for (int i = 0; i < PUBLISH_COUNT*TRIAC_CHANNELS; i++) {
+    publishMem[i].value[0] = '\0';
     publishMem[i].updateCounter = 0;
+    topicTable[i][0] = '\0';
+  }
+  for (byte id = 0; id < DIAG_TOPICS; id++) {
+    diagTopics[id][0] = '\0';
   }
   clientId = "";
   connected = false;
+  diagCounter = 0;
+  allocations = 0;
 }
 
 void cMqtt::init() {
@@ -39,6 +55,7 @@ void cMqtt::init() {
     client.setServer(settings.getString(settings.brokerAddress).c_str(), settings.getShort(settings.mqttPort));
   }
   client.setCallback(callback);
+  buildTopics();
   clientId = String(dev_mdl) + "_" + iotWifi.MacPart(6);
   conTimer = xTimerCreateStatic("", pdMS_TO_TICKS(MQTT_RECONNECT_TIME), pdFALSE, (void *)CONNECT_TIMER, timerCallback, &conTimerBuffer);
   reconnect_wait = false;
@@ -47,7 +64,7 @@ void cMqtt::init() {
 }
 
 void cMqtt::handle() {
-  if ((iotWifi.connected) && ((boolean)settings.getByte(settings.UseMqtt))) {
+  if ((iotWifi.connected) && ((boolean)settings.data().UseMqtt)) {
     isConnected();
     if (!connected) {
       if (!reconnect_wait) {
@@ -91,24 +108,41 @@ String cMqtt::fixTopic(String topic) {
   return topic;
 }
 
-String cMqtt::getValue(String tag) {
-  String value = "";
-  if (tag == light_status) {
-    value = String(waveform.getStatus());
-  } else if (tag == dim_status) {
-    value = String(waveform.getPower());
-  } else if (tag == freq_status) {
-    value = String(triac.getFreq());
-  } else if (tag == mode_status) {
-    value = String(waveform.getMode());
-  } else if (tag == effect_status) {
-    value = String(waveform.getEffect());
+String cMqtt::getValue(String tag, byte channel) {
+  char value[MQTT_VALUE_SIZE] = "";
+  for (byte i = 0; i < PUBLISH_COUNT; i++) {
+    if (tag == PublishTopics[i].tag) {
+      formatValue(i, channel, value);
+    }
   }
-  return value;
+  return String(value);
+}
+
+String cMqtt::buildTopic(String tag, byte channel) {
+  if (channel > 0) {
+    return String(settings.data().mainTopic) + "/" + channel_prefix + String(channel) + "/" + tag;
+  }
+  return String(settings.data().mainTopic) + "/" + tag;
+}
+
+void cMqtt::buildTopics() { // at init and when the main topic changes, publishing only reads them
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    for (byte i = 0; i < PUBLISH_COUNT; i++) {
+      if ((ch > 0) && (i == pub_freq)) { // mains frequency is common
+        topicTable[ch*PUBLISH_COUNT + i][0] = '\0';
+      } else {
+        snprintf(topicTable[ch*PUBLISH_COUNT + i], MQTT_TOPIC_SIZE, "%s", buildTopic(PublishTopics[i].tag, ch).c_str());
+      }
+    }
+  }
+  for (byte id = 0; id < CDiag::histnr; id++) {
+    snprintf(diagTopics[id], MQTT_TOPIC_SIZE, "%s/%s", buildTopic(diag_topic).c_str(), diag.getName(id).c_str());
+  }
+  snprintf(diagTopics[CDiag::histnr], MQTT_TOPIC_SIZE, "%s/%s", buildTopic(diag_topic).c_str(), publish_alloc);
 }
 
-String cMqtt::buildTopic(String tag) {
-  return settings.getString(settings.mainTopic) + "/" + tag;
+unsigned long cMqtt::getAllocations() {
+  return allocations;
 }
 
 ///////////// PRIVATES ///////////////////////////
@@ -119,47 +153,60 @@ void cMqtt::callback(char* topic, byte* payload, unsigned int length) {
 
   tag = getTag(String(topic));
   payld = bp2string(payload, length);
+  CWaveform &wf = waveforms[getChannel(String(topic), tag)];
   logger.printf(LOG_MQTT, "Message received [" +  String(topic) + "] " + String(payld));
   if (tag == dim_offon) {
     if (getBoolean(payld)) {
       logger.printf(LOG_MQTTCMD, "Command ON");
-      waveform.setPower(settings.getByte(settings.LevelOn));
+      wf.setPower(settings.getByte(settings.LevelOn));
     } else {
       logger.printf(LOG_MQTTCMD, "Command OFF");
-      waveform.setPower(settings.getByte(settings.LevelOff));
+      wf.setPower(settings.getByte(settings.LevelOff));
     }
     LED.Command();
   } else if (tag == dim_off) {
     if (getBoolean(payld)) {
       logger.printf(LOG_MQTTCMD, "Command OFF");
-      waveform.setPower(settings.getByte(settings.LevelOff));
+      wf.setPower(settings.getByte(settings.LevelOff));
     }
     LED.Command();
   } else if (tag == dim_on) {
     if (getBoolean(payld)) {
       logger.printf(LOG_MQTTCMD, "Command ON");
-      waveform.setPower(settings.getByte(settings.LevelOn));
+      wf.setPower(settings.getByte(settings.LevelOn));
     }
     LED.Command();
   } else if (tag == dim_lounge) {
     if (getBoolean(payld)) {
       logger.printf(LOG_MQTTCMD, "Command LOUNGE");
-      waveform.setPower(settings.getByte(settings.LevelLounge));
+      wf.setPower(settings.getByte(settings.LevelLounge));
     }
     LED.Command();
   } else if (tag == dim_dim) {
     logger.printf(LOG_MQTTCMD, "Command POWER");
-    waveform.setPower(getPercentage(payld));
+    wf.setLevel(getLevel(payld));
     LED.Command();
   } else if (tag == dim_mode) {
     logger.printf(LOG_MQTTCMD, "Command MODE");
-    waveform.setMode(getByte(payld));
+    wf.setMode(getByte(payld));
   } else if (tag == dim_effect) {
     logger.printf(LOG_MQTTCMD, "Command EFFECT");
-    waveform.setEffect(getByte(payld));
+    wf.setEffect(getByte(payld));
   } else if (tag == dim_input) {
     logger.printf(LOG_MQTTCMD, "Command INPUT");
-    waveform.setInput(getInt(payld));
+    wf.setInput(getInt(payld));
+  } else if (tag == dim_layer) {
+    long values[5];
+    logger.printf(LOG_MQTTCMD, "Command LAYER");
+    if (getList(payld, values, 5)) {
+      wf.setLayer((byte)values[0], (byte)values[1], (byte)values[2], (byte)values[3], (unsigned short)values[4]);
+    }
+  } else if (tag == dim_scene) {
+    logger.printf(LOG_MQTTCMD, "Command SCENE");
+    scene.load(payload, length);
+  } else if (tag == dim_sceneplay) {
+    logger.printf(LOG_MQTTCMD, "Command SCENEPLAY");
+    wf.setScene(getBoolean(payld));
   } else if ((getMain(topic) == settings.getString(settings.haTopic)) && (tag == ha_status)) { //homeassistant/status
     if (payld == ha_online) {
       logger.printf(LOG_MQTTCMD, "HA online");
@@ -178,32 +225,155 @@ void cMqtt::callback(char* topic, byte* payload, unsigned int length) {
 
 void cMqtt::sendStatus() { // publish on connected or (every ten minutes or) when value changes (5 seconds for temperature and light, 1 second for pos)
   if ((connected) && (doPub)) {
+    bool publish[PUBLISH_COUNT*TRIAC_CHANNELS];
     portENTER_CRITICAL(&mux);
     doPub = false;
     portEXIT_CRITICAL(&mux);
-    int publishLen = (sizeof(PublishTopics) / sizeof(topics));
-    for (int i = 0; i < publishLen; i++) {
-      String val = getValue(PublishTopics[i].tag);
-      if ((PublishTopics[i].tag == dim_status) || (PublishTopics[i].tag == light_status)) {
-        if (val != publishMem[i].value) {
-          client.publish(buildTopic(PublishTopics[i].tag).c_str(), val.c_str(), (boolean)settings.getByte(settings.mqttRetain));
-          publishMem[i].value = val;
-          publishMem[i].updateCounter = 0;
-          logger.printf(LOG_MQTT, "Message published [" + String(buildTopic(PublishTopics[i].tag)) + "] " + String(val));
-        }
-      } else {
-        if ((publishMem[i].updateCounter >= 5) && (val != publishMem[i].value)) {
-          client.publish(buildTopic(PublishTopics[i].tag).c_str(), val.c_str(), (boolean)settings.getByte(settings.mqttRetain));
-          publishMem[i].value = val;
-          publishMem[i].updateCounter = 0;
-          logger.printf(LOG_MQTT, "Message published [" + String(buildTopic(PublishTopics[i].tag)) + "] " + String(val));
+    startAllocations(); // the whole pass, formatting and publishing
+    pollValues(publish);
+    for (int i = 0; i < PUBLISH_COUNT*TRIAC_CHANNELS; i++) {
+      if (publish[i]) {
+        publishValue(i);
+      }
+    }
+    allocations += stopAllocations();
+    if (logger.isEnabled(LOG_MQTT)) { // after the pass, logging builds strings
+      for (int i = 0; i < PUBLISH_COUNT*TRIAC_CHANNELS; i++) {
+        if (publish[i]) {
+          logValue(i);
         }
       }
-      publishMem[i].updateCounter++;
+    }
+    if (++diagCounter >= DIAG_PUBLISH) {
+      diagCounter = 0;
+      sendDiag();
     }
   }
 }
 
+void cMqtt::pollValues(bool *publish) { // steady state, fixed buffers only
+  char val[MQTT_VALUE_SIZE];
+  for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+    for (byte i = 0; i < PUBLISH_COUNT; i++) {
+      int index = ch*PUBLISH_COUNT + i;
+      valueMem *mem = &publishMem[index];
+      publish[index] = false;
+      if (topicTable[index][0] == '\0') {
+        continue;
+      }
+      formatValue(i, ch, val);
+      if (((i == pub_dim) || (i == pub_light) || (mem->updateCounter >= 5)) && (strcmp(val, mem->value) != 0)) {
+        memcpy(mem->value, val, MQTT_VALUE_SIZE);
+        mem->updateCounter = 0;
+        publish[index] = true;
+      }
+      mem->updateCounter++;
+    }
+  }
+}
+
+void cMqtt::publishValue(int index) {
+  client.publish(topicTable[index], publishMem[index].value, (boolean)settings.data().mqttRetain);
+}
+
+void cMqtt::logValue(int index) {
+  logger.printf(LOG_MQTT, "Message published [" + String(topicTable[index]) + "] " + String(publishMem[index].value));
+}
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+void cMqtt::startAllocations() { // count every allocation made by this task, other tasks keep running
+  allocCount = 0;
+  allocTask = xTaskGetCurrentTaskHandle();
+}
+
+unsigned long cMqtt::stopAllocations() {
+  allocTask = NULL;
+  return allocCount;
+}
+#else
+void cMqtt::startAllocations() { // no hooks, heap not given back by the end of the pass (includes other tasks)
+  allocFree = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
+unsigned long cMqtt::stopAllocations() {
+  size_t now = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+  if (now < allocFree) {
+    return allocFree - now;
+  }
+  return 0;
+}
+#endif
+
+void cMqtt::formatValue(byte id, byte channel, char *value) {
+  switch (id) {
+    case pub_light:
+      formatFixed(value, waveforms[channel].getStatus() ? 1 : 0, 0);
+      break;
+    case pub_dim:
+      formatFixed(value, waveforms[channel].getPower(), 0);
+      break;
+    case pub_freq: // [Hz] 2 decimals
+      formatFixed(value, (unsigned long)(triac.getFreq()*100 + 0.5), 2);
+      break;
+    case pub_mode:
+      formatFixed(value, waveforms[channel].getMode(), 0);
+      break;
+    case pub_effect:
+      formatFixed(value, waveforms[channel].getEffect(), 0);
+      break;
+    default:
+      value[0] = '\0';
+  }
+}
+
+char *cMqtt::formatFixed(char *text, unsigned long value, byte decimals) { // fixed point to text, no heap
+  char digits[MQTT_VALUE_SIZE];
+  byte n = 0;
+  char *pos = text;
+  do {
+    digits[n++] = '0' + (value % 10);
+    value /= 10;
+  } while (((value > 0) || (n <= decimals)) && (n < MQTT_VALUE_SIZE - 2));
+  while (n > 0) {
+    *pos++ = digits[--n];
+    if ((n == decimals) && (n > 0)) {
+      *pos++ = '.';
+    }
+  }
+  *pos = '\0';
+  return text;
+}
+
+char *cMqtt::formatHistogram(char *text, byte id) { // {"count":n,"max":n,"buckets":[..]}, no heap
+  CDiag::histogram hist;
+  char *pos = text;
+  diag.getHistogram(id, hist);
+  pos += strlen(strcpy(pos, "{\"count\":"));
+  pos += strlen(formatFixed(pos, hist.count, 0));
+  pos += strlen(strcpy(pos, ",\"max\":"));
+  pos += strlen(formatFixed(pos, hist.max, 0));
+  pos += strlen(strcpy(pos, ",\"buckets\":["));
+  for (byte i = 0; i < DIAG_BUCKETS; i++) {
+    if (i > 0) {
+      *pos++ = ',';
+    }
+    pos += strlen(formatFixed(pos, hist.bucket[i], 0));
+  }
+  strcpy(pos, "]}");
+  return text;
+}
+
+void cMqtt::sendDiag() { // prebuilt topics and fixed buffers, like the status pass
+  char payload[MQTT_DIAG_SIZE];
+  for (byte id = 0; id < CDiag::histnr; id++) {
+    client.publish(diagTopics[id], formatHistogram(payload, id), false);
+  }
+  client.publish(diagTopics[CDiag::histnr], formatFixed(payload, allocations, 0), false);
+  if (logger.isEnabled(LOG_MQTT)) {
+    logger.printf(LOG_MQTT, "Diagnostics published [" + buildTopic(diag_topic) + "]");
+  }
+}
+
 void cMqtt::isConnected() {
   if (connected) {
     connected = client.connected();
@@ -217,10 +387,9 @@ void cMqtt::isConnected() {
 
 void cMqtt::reconnect() {
   int state = 0;
-  String username = settings.getString(settings.mqttUsername);
-  String password = settings.getString(settings.mqttPassword);
-  if (username.length() > 0) {
-    client.connect(clientId.c_str(), username.c_str(), password.c_str());
+  const settingsdata &cfg = settings.data(); // credentials are held decrypted
+  if (cfg.mqttUsername[0] != '\0') {
+    client.connect(clientId.c_str(), cfg.mqttUsername, cfg.mqttPassword);
   } else {
     client.connect(clientId.c_str());
   } // don't use connect return value, as it returns old connection status.
@@ -232,19 +401,22 @@ void cMqtt::reconnect() {
     logger.printf(logger.l13, "MQTT connected");
     if ((boolean)settings.getByte(settings.haDisco)) {
       String hatopic = settings.getString(settings.haTopic) + "/" + ha_status;
-      client.subscribe(hatopic.c_str(), (int)settings.getByte(settings.mqttQos));
+      client.subscribe(hatopic.c_str(), (int)settings.data().mqttQos);
     }
-    int publishLen = (sizeof(PublishTopics) / sizeof(topics));
     int subscribeLen = (sizeof(SubscribeTopics) / sizeof(topics));
-    for (int i = 0; i < subscribeLen; i++) {
-      client.subscribe(buildTopic(SubscribeTopics[i].tag).c_str(), (int)settings.getByte(settings.mqttQos));
-    }
-    for (int i = 0; i < publishLen; i++) {
-      String val = getValue(PublishTopics[i].tag);
-      client.publish(buildTopic(PublishTopics[i].tag).c_str(), val.c_str(), (boolean)settings.getByte(settings.mqttRetain));
-      publishMem[i].value = val;
-      publishMem[i].updateCounter = 1;
-      logger.printf(LOG_MQTT, "Message published [" + String(buildTopic(PublishTopics[i].tag)) + "] " + String(val));
+    for (byte ch = 0; ch < TRIAC_CHANNELS; ch++) {
+      for (int i = 0; i < subscribeLen; i++) {
+        client.subscribe(buildTopic(SubscribeTopics[i].tag, ch).c_str(), (int)settings.data().mqttQos);
+      }
+      for (byte i = 0; i < PUBLISH_COUNT; i++) {
+        int index = ch*PUBLISH_COUNT + i;
+        if (topicTable[index][0] == '\0') { // mains frequency is common
+          continue;
+        }
+        formatValue(i, ch, publishMem[index].value);
+        publishMem[index].updateCounter = 1;
+        publishValue(index);
+      }
     }
     update();
   } else {
@@ -389,6 +561,16 @@ String cMqtt::getMain(String topic) {
   return tag;
 }
 
+byte cMqtt::getChannel(String topic, String tag) {
+  byte channel = 0;
+  for (byte ch = 1; ch < TRIAC_CHANNELS; ch++) {
+    if (topic == mqtt.buildTopic(tag, ch)) {
+      channel = ch;
+    }
+  }
+  return channel;
+}
+
 String cMqtt::bp2string(byte *payload, unsigned int length) {
   String payld = "";
   for (int i = 0; i < length; i++) {
@@ -406,7 +588,7 @@ boolean cMqtt::getBoolean(String payload) {
   return value;
 }
 
-byte cMqtt::getPercentage(String payload) {
+unsigned short cMqtt::getLevel(String payload) { // fractional percentage to level
   float perc = 0;
   perc = payload.toFloat();
   if (perc < 0) {
@@ -415,7 +597,7 @@ byte cMqtt::getPercentage(String payload) {
   if (perc > 100) {
     perc = 100;
   }
-  return (byte)round(perc);
+  return (unsigned short)round(perc*LEVEL_ON/PWR_ON);
 }
 
 byte cMqtt::getByte(String payload) {
@@ -436,6 +618,19 @@ int cMqtt::getInt(String payload) {
   return (int)round(f);
 }
 
+bool cMqtt::getList(String payload, long *values, byte n) { // comma separated integers
+  int start = 0;
+  for (byte i = 0; i < n; i++) {
+    int end = payload.indexOf(',', start);
+    if ((end < 0) && (i < n - 1)) {
+      return false;
+    }
+    values[i] = payload.substring(start, (end < 0) ? payload.length() : end).toInt();
+    start = end + 1;
+  }
+  return true;
+}
+
 String cMqtt::joinTopic(String Topic, String tag) {
   return Topic + "/" + tag;
 }
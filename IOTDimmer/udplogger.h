@@ -77,6 +77,7 @@ class cUdpLogger {
     void printf(loglevel level, String data);
     void enable(bool bEnable);
     bool isEnabled();
+    bool isEnabled(loglevel level); // printf(level, ...) would send
     void setDebug(uint16_t level);
     uint16_t getDebug();
   private:
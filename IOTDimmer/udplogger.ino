@@ -47,6 +47,11 @@ bool cUdpLogger::isEnabled() {
   return enabled;
 }
 
+bool cUdpLogger::isEnabled(loglevel level) {
+  uint16_t mask = 1 << (uint8_t)level;
+  return ((debugLevel & mask) != 0) && ((connected) && (enabled));
+}
+
 void cUdpLogger::setDebug(uint16_t level) {
   debugLevel = level;
 }
@@ -0,0 +1,62 @@
+/*
+ * IOTDimmer - host tests
+ * Minimal Arduino environment to run single modules on the build host
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define LOW  0
+#define HIGH 1
+
+#ifndef TRIAC_CHANNELS
+#define TRIAC_CHANNELS 1
+#endif
+
+typedef int portMUX_TYPE; // single threaded
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_ISR(mux)
+#define portEXIT_CRITICAL_ISR(mux)
+typedef void *TaskHandle_t;      // declarations only, no tasks on the host
+typedef void *SemaphoreHandle_t;
+typedef int StaticSemaphore_t;
+
+template <class T> T min(T a, T b) { return (a < b) ? a : b; }
+template <class T> T max(T a, T b) { return (a > b) ? a : b; }
+
+extern unsigned long hostMicros; // [us] clock, set by the test
+inline unsigned long micros() { return hostMicros; }
+inline unsigned long millis() { return hostMicros/1000; }
+
+class String : public std::string {
+public:
+  String(const char *text = "") : std::string(text) {}
+  String(const std::string &text) : std::string(text) {}
+  String(long value) : std::string(std::to_string(value)) {}
+  String(int value) : std::string(std::to_string(value)) {}
+  String(unsigned long value) : std::string(std::to_string(value)) {}
+};
+
+class IPAddress {
+public:
+  IPAddress(uint32_t iaddress = 0) : address(iaddress) {}
+  uint32_t address;
+};
+
+#endif
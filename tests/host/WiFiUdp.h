@@ -0,0 +1,50 @@
+/*
+ * IOTDimmer - host tests
+ * WiFiUDP stand-in: received packets are queued by the test, sent packets are kept
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef WiFiUdp_h
+#define WiFiUdp_h
+
+#include <deque>
+#include <vector>
+#include "Arduino.h"
+
+class WiFiUDP {
+public:
+  uint8_t begin(uint16_t port) { return 1; }
+  void stop() {}
+  int parsePacket() {
+    if (received.empty()) {
+      return 0;
+    }
+    packet = received.front();
+    received.pop_front();
+    return (int)packet.size();
+  }
+  int read(unsigned char *data, size_t length) {
+    size_t n = min(length, packet.size());
+    memcpy(data, packet.data(), n);
+    return (int)n;
+  }
+  IPAddress remoteIP() { return IPAddress(0x0100007F); }
+  uint16_t remotePort() { return 4211; }
+  int beginPacket(IPAddress ip, uint16_t port) { out.clear(); return 1; }
+  size_t write(const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+      out.push_back(data[i]);
+    }
+    return length;
+  }
+  int endPacket() { sent.push_back(out); return 1; }
+  static std::deque<std::vector<byte> > received;
+  static std::vector<std::vector<byte> > sent;
+private:
+  std::vector<byte> packet;
+  std::vector<byte> out;
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * IOTDimmer - host tests
+ * Check macros and stand-ins for the modules around the one under test
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#ifndef test_h
+#define test_h
+
+#include <stdio.h>
+#include <vector>
+#include "Arduino.h"
+
+unsigned long hostMicros = 0;
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+#define CHECK_EQ(a, b) do { long long checkA = (long long)(a), checkB = (long long)(b); \
+  if (checkA != checkB) { printf("%s:%d: %s = %lld, expected %lld\n", __FILE__, __LINE__, #a, checkA, checkB); failures++; } } while (0)
+
+inline int testResult(const char *name) {
+  printf("%s: %s\n", name, failures ? "FAILED" : "passed");
+  return failures ? 1 : 0;
+}
+
+#define LOG_WAVEFORM 0
+struct CLogger { // drops everything
+  template <class... T> void printf(T...) {}
+} logger;
+
+struct CDiag { // records the last value only
+  enum histid {streamdelay = 6};
+  void record(histid id, unsigned long value) { last = value; }
+  unsigned long last;
+} diag;
+
+struct CWaveform { // keeps the stream input history
+  void streamInput(int input) { inputs.push_back(input); }
+  std::vector<int> inputs;
+} waveforms[TRIAC_CHANNELS];
+
+#endif
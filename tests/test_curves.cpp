@@ -0,0 +1,77 @@
+/*
+ * IOTDimmer - host tests
+ * Q15 curves: accuracy against libm and a micro benchmark
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include <chrono>
+#include "test.h"
+#include "Curves.h"
+#include "Curves.ino"
+
+#define BENCH_RUNS 100
+
+static volatile long sink;
+
+static double maxError(long (*curve)(unsigned long), double (*exact)(double)) { // [Q15 lsb]
+  double worst = 0;
+  for (unsigned long phase = 0; phase <= PHASE_ONE; phase++) {
+    double err = fabs(curve(phase) - exact((double)phase/PHASE_ONE)*CURVE_ONE);
+    if (err > worst) {
+      worst = err;
+    }
+  }
+  return worst;
+}
+
+static double exactQuarter(double x) { return sin(M_PI/2*x); }
+static double exactEase(double x) { return (1 - cos(M_PI*x))/2; }
+static double exactSine(double x) { return sin(2*M_PI*x); }
+
+static void testAccuracy() {
+  double quarterErr = maxError(CCurves::quarter, exactQuarter);
+  double easeErr = maxError(CCurves::ease, exactEase);
+  double sineErr = maxError(CCurves::sine, exactSine);
+  printf("max error [Q15 lsb]: quarter %.2f, ease %.2f, sine %.2f\n", quarterErr, easeErr, sineErr);
+  CHECK(quarterErr <= 4.0);  // 64 step table, linear in between
+  CHECK(easeErr <= 8.0);     // squared, truncated
+  CHECK(sineErr <= 4.0);
+  CHECK_EQ(CCurves::quarter(0), 0);
+  CHECK_EQ(CCurves::quarter(PHASE_ONE), CURVE_ONE);
+  CHECK_EQ(CCurves::quarter(2*PHASE_ONE), CURVE_ONE); // clamped
+  CHECK_EQ(CCurves::ease(PHASE_ONE), CURVE_ONE);
+  CHECK_EQ(CCurves::sine(PHASE_ONE/4), CURVE_ONE);
+  CHECK_EQ(CCurves::sine(3*PHASE_ONE/4), -CURVE_ONE);
+  for (unsigned long phase = 1; phase <= PHASE_ONE; phase++) { // fades never step back
+    CHECK(CCurves::quarter(phase) >= CCurves::quarter(phase - 1));
+    CHECK(CCurves::ease(phase) >= CCurves::ease(phase - 1));
+  }
+}
+
+template <class F> static double benchmark(F f) { // [ns] per call
+  auto start = std::chrono::steady_clock::now();
+  long sum = 0;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    for (unsigned long phase = 0; phase < PHASE_ONE; phase++) {
+      sum += f(phase ^ (run*0x9E37UL));
+    }
+  }
+  sink = sum;
+  std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+  return time.count() / (BENCH_RUNS*PHASE_ONE);
+}
+
+static void testBenchmark() {
+  double table = benchmark([](unsigned long phase) { return CCurves::sine(phase); });
+  double libm = benchmark([](unsigned long phase) { return (long)(sin(2*M_PI*(phase % PHASE_ONE)/PHASE_ONE)*CURVE_ONE); });
+  double libmFloat = benchmark([](unsigned long phase) { return (long)(sinf(2*(float)M_PI*(phase % PHASE_ONE)/PHASE_ONE)*CURVE_ONE); });
+  printf("sine: Q15 table %.1f ns, libm double %.1f ns, libm float %.1f ns (host, the ESP32-S2 has no fpu)\n", table, libm, libmFloat);
+}
+
+int main() {
+  testAccuracy();
+  testBenchmark();
+  return testResult("test_curves");
+}
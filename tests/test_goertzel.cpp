@@ -0,0 +1,76 @@
+/*
+ * IOTDimmer - host tests
+ * Audio band energy: Goertzel bins on synthetic tones, envelope attack and release
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "test.h"
+#include "Curves.h"
+#include "Audio.h"
+#include "Curves.ino"
+#include "Audio.ino"
+
+#define ADC_MID    2048 // 12 bit adc, biased input
+#define AMPLITUDE  400  // [adc units]
+
+static unsigned long sampleN = 0; // continuous phase over blocks
+
+static void feed(double freq, double amplitude, int blocks) {
+  short block[AUDIO_BLOCK];
+  for (int b = 0; b < blocks; b++) {
+    for (int i = 0; i < AUDIO_BLOCK; i++, sampleN++) {
+      block[i] = (short)lround(ADC_MID + amplitude*sin(2*M_PI*freq*sampleN/AUDIO_RATE));
+    }
+    audio.process(block, AUDIO_BLOCK);
+  }
+}
+
+static void testTone(byte band) {
+  audio.init();
+  feed(audioBands[band], AMPLITUDE, 20); // envelope settled
+  for (byte b = 0; b < AUDIO_BANDS; b++) {
+    long value = audio.getBand(b);
+    printf("tone %u Hz: band %u Hz = %ld\n", audioBands[band], audioBands[b], value);
+    if (b == band) {
+      CHECK(labs(value - AMPLITUDE) <= AMPLITUDE/20); // amplitude within 5 %
+    } else {
+      CHECK(value <= AMPLITUDE/10);                   // leakage below 10 %
+    }
+  }
+}
+
+static void testEnvelope() {
+  audio.init();
+  feed(audioBands[1], AMPLITUDE, 1);
+  long first = audio.getBand(1);
+  CHECK((first >= AMPLITUDE/2 - 8) && (first < AMPLITUDE)); // attack 1/2 per block
+  feed(audioBands[1], AMPLITUDE, 20);
+  long settled = audio.getBand(1);
+  feed(0, 0, 1); // silence, dc only
+  long released = audio.getBand(1);
+  CHECK((released < settled) && (released >= settled - settled/16 - 1)); // release 1/16 per block
+  feed(0, 0, 200);
+  CHECK(audio.getLevel() < AUDIO_BANDS); // the release step stops below 1 adc unit per band
+}
+
+static void testInput() {
+  audio.init();
+  waveforms[0].inputs.clear();
+  audio.handle();
+  CHECK(waveforms[0].inputs.empty()); // nothing processed
+  feed(audioBands[0], AMPLITUDE, 20);
+  audio.handle();
+  CHECK_EQ(waveforms[0].inputs.size(), 1);
+  CHECK_EQ(waveforms[0].inputs.back(), audio.getLevel());
+}
+
+int main() {
+  for (byte band = 0; band < AUDIO_BANDS; band++) {
+    testTone(band);
+  }
+  testEnvelope();
+  testInput();
+  return testResult("test_goertzel");
+}
@@ -0,0 +1,99 @@
+/*
+ * IOTDimmer - host tests
+ * Ignition table: accuracy against the per call computation it replaces, and a benchmark
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include <chrono>
+#include "test.h"
+#include "Curves.h"
+#include "Triac.h"
+#include "Ignition.ino"
+
+#define ZERO_TIME  10000UL // [us] 50 Hz
+#define BENCH_RUNS 20
+
+static volatile unsigned long sink;
+
+static double exactTime(unsigned short level, bool power) { // per call, as before the table
+  double output = (double)level / LEVEL_ON; // linear lamp curve
+  if (!power) {
+    return ZERO_TIME*(1.0 - output);
+  }
+  return (acos(2.0*output - 1.0) * ZERO_TIME) / M_PI;
+}
+
+static void build(CIgnition &table, bool power) {
+  long output[PWR_ON+1];
+  for (int i = PWR_OFF; i <= PWR_ON; i++) {
+    output[i] = (CURVE_ONE*i + PWR_ON/2)/PWR_ON;
+  }
+  table.build(ZERO_TIME, power ? 1 : 0, power, output);
+}
+
+static double maxError(CIgnition &table, bool power, unsigned long from, unsigned long to) {
+  double worst = 0;
+  for (unsigned long level = from; level <= to; level += 7) {
+    double err = fabs((double)table.getTime((unsigned short)level) - exactTime((unsigned short)level, power));
+    if (err > worst) {
+      worst = err;
+    }
+  }
+  return worst;
+}
+
+static void testAccuracy() {
+  CIgnition timed;
+  CIgnition power;
+  CHECK_EQ(timed.getZeroTime(), 0); // not built
+  build(timed, false);
+  build(power, true);
+  CHECK_EQ(timed.getZeroTime(), ZERO_TIME);
+  CHECK_EQ(power.getMode(), 1);
+  for (byte p = PWR_OFF; p <= PWR_ON; p++) { // exact on the percentages
+    CHECK(fabs(timed.getTime(LEVEL_PERCENT(p)) - exactTime(LEVEL_PERCENT(p), false)) <= 1.0);
+    CHECK(fabs(power.getTime(LEVEL_PERCENT(p)) - exactTime(LEVEL_PERCENT(p), true)) <= 1.0);
+  }
+  double timedErr = maxError(timed, false, 0, LEVEL_ON);
+  double powerErr = maxError(power, true, 0, LEVEL_ON);
+  double powerDimErr = maxError(power, true, LEVEL_DIM_MIN, LEVEL_DIM_MAX);
+  printf("interpolation error timed %.1f us, power %.1f us (%.1f us within the dim range)\n", timedErr, powerErr, powerDimErr);
+  CHECK(timedErr <= 1.0);
+  CHECK(powerErr <= 200.0);   // acos is steepest between 0 and 1 % and between 99 and 100 %
+  CHECK(powerDimErr <= 20.0);
+  for (unsigned long level = LEVEL_DIM_MIN; level <= LEVEL_DIM_MAX; level += 13) { // and back
+    long back = power.getLevel(power.getTime((unsigned short)level));
+    CHECK(labs(back - (long)level) <= 256);
+  }
+  CHECK_EQ(power.getLevel(0), LEVEL_ON);
+  CHECK_EQ(power.getLevel(ZERO_TIME), LEVEL_OFF);
+}
+
+template <class F> static double benchmark(F f) { // [ns] per call
+  auto start = std::chrono::steady_clock::now();
+  unsigned long sum = 0;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    for (unsigned long level = 0; level <= LEVEL_ON; level++) {
+      sum += f((unsigned short)(level ^ (run*0x9E37)));
+    }
+  }
+  sink = sum;
+  std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+  return time.count() / (BENCH_RUNS*(LEVEL_ON + 1));
+}
+
+static void testBenchmark() {
+  CIgnition power;
+  build(power, true);
+  double table = benchmark([&](unsigned short level) { return power.getTime(level); });
+  double direct = benchmark([](unsigned short level) { return (unsigned long)round(exactTime(level, true)); });
+  printf("power mode ignition time: table %.1f ns, per call acos %.1f ns (host, the ESP32-S2 has no fpu)\n", table, direct);
+}
+
+int main() {
+  testAccuracy();
+  testBenchmark();
+  return testResult("test_ignition");
+}
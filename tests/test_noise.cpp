@@ -0,0 +1,88 @@
+/*
+ * IOTDimmer - host tests
+ * Seeded noise: reproducible sequences for NOISE_SEED, ranges and continuity
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#include "test.h"
+#include "Curves.h"
+#include "Noise.h"
+#include "Noise.ino"
+
+#define SEED 1234
+
+// golden values, checked against an independent lowbias32/xorshift32 implementation
+static const uint32_t goldenNext[] = {0x067B7C8EUL, 0x54BB871BUL, 0xAF4653D7UL, 0xC2ACA869UL};
+static const long goldenCandle[] = {17258, 4327, -19506, 1824}; // pos 0, 40000, 80000, 120000
+
+static void testGolden() {
+  CNoise rng(SEED);
+  CHECK_EQ(CNoise::hash(SEED, 0), 0x400C726EUL);
+  for (byte i = 0; i < 4; i++) {
+    CHECK_EQ(rng.next(), goldenNext[i]);
+    CHECK_EQ(CNoise::candle(SEED, (unsigned long long)i*40000), goldenCandle[i]);
+  }
+}
+
+static void testReproducible() {
+  CNoise a(SEED);
+  CNoise b(SEED + 1);
+  CNoise c;
+  bool differs = false;
+  c.seed(SEED); // reseeding restarts the sequence
+  for (int i = 0; i < 1000; i++) {
+    uint32_t va = a.next();
+    CHECK_EQ(va, c.next());
+    CHECK(va != 0); // xorshift never reaches 0
+    differs |= (va != b.next());
+  }
+  CHECK(differs);
+  for (uint32_t seed = 0; seed < 1000; seed++) { // also the seeds that hash to 0
+    CNoise z(seed);
+    CHECK(z.next() != 0);
+  }
+}
+
+static void testRange() {
+  CNoise rng(SEED);
+  long low = 50;
+  long high = -50;
+  for (int i = 0; i < 10000; i++) {
+    long v = rng.range(-50, 50);
+    CHECK((v >= -50) && (v < 50));
+    low = min(low, v);
+    high = max(high, v);
+  }
+  CHECK_EQ(low, -50); // both ends are reached
+  CHECK_EQ(high, 49);
+  CHECK_EQ(rng.range(7, 7), 7);
+  CHECK_EQ(rng.range(7, 3), 7);
+}
+
+static void testContinuity() {
+  long prev = CNoise::value(SEED, 0);
+  long maxStep = 0;
+  for (unsigned long long pos = 1; pos < 64*NOISE_ONE; pos += 64) {
+    long v = CNoise::value(SEED, pos);
+    long c = CNoise::candle(SEED, pos);
+    CHECK((v >= -CURVE_ONE) && (v <= CURVE_ONE));
+    CHECK((c >= -CURVE_ONE) && (c <= CURVE_ONE));
+    maxStep = max(maxStep, labs(v - prev));
+    prev = v;
+  }
+  // smoothstep slope peaks at 1.5 x lattice difference (at most 2 x CURVE_ONE) per step
+  CHECK(maxStep <= (long)((3*CURVE_ONE*64)/NOISE_ONE + 2));
+  for (uint32_t n = 0; n < 16; n++) { // value equals the lattice at the lattice points
+    CHECK_EQ(CNoise::value(SEED, n*NOISE_ONE), (long)(CNoise::hash(SEED, n) >> 16) - CURVE_ONE);
+  }
+}
+
+int main() {
+  testGolden();
+  testReproducible();
+  testRange();
+  testContinuity();
+  return testResult("test_noise");
+}
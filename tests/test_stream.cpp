@@ -0,0 +1,147 @@
+/*
+ * IOTDimmer - host tests
+ * Input stream jitter buffer: playout order, loss and late accounting, loopback echo
+ * Version 0.80
+ * 17-10-2026
+ * Copyright: Ivo Helwegen
+ */
+
+#define STREAM_PORT 4210
+#include "test.h"
+#include "WiFiUdp.h"
+#include "InputStream.h"
+#include "InputStream.ino"
+
+std::deque<std::vector<byte> > WiFiUDP::received;
+std::vector<std::vector<byte> > WiFiUDP::sent;
+
+#define PERIOD  10000UL   // [us] between samples
+#define OFFSET  5000000UL // [us] local clock - sender clock, transit is constant
+
+static unsigned long getLong(const std::vector<byte> &data, size_t pos) {
+  return (unsigned long)data[pos] | ((unsigned long)data[pos+1] << 8) | ((unsigned long)data[pos+2] << 16) | ((unsigned long)data[pos+3] << 24);
+}
+
+static void putLong(std::vector<byte> &data, unsigned long value) {
+  for (byte i = 0; i < 4; i++) {
+    data.push_back((byte)(value >> (8*i)));
+  }
+}
+
+// one packet of count samples with value seq*10 + i, sent at the stamp of its last sample
+static void receive(byte channel, unsigned long seq, byte count) {
+  std::vector<byte> data = {'I', 'S', channel, count};
+  putLong(data, seq);
+  putLong(data, seq*PERIOD);
+  data.push_back((byte)(PERIOD & 0xFF));
+  data.push_back((byte)(PERIOD >> 8));
+  for (byte i = 0; i < count; i++) {
+    short value = (short)((seq + i)*10);
+    data.push_back((byte)(value & 0xFF));
+    data.push_back((byte)((unsigned short)value >> 8));
+  }
+  WiFiUDP::received.push_back(data);
+  hostMicros = (seq + count - 1)*PERIOD + OFFSET;
+  inputStream.handle();
+}
+
+static void playAt(unsigned long seq) { // when sample seq is due
+  hostMicros = seq*PERIOD + OFFSET + STREAM_DELAY_US;
+  inputStream.play();
+}
+
+static void restart(CInputStream &stream) {
+  stream.disconnect();
+  stream.connect();
+  waveforms[0].inputs.clear();
+  WiFiUDP::sent.clear();
+}
+
+static void testOrder() {
+  restart(inputStream);
+  receive(0, 100, 2);
+  receive(0, 104, 2); // out of order
+  receive(0, 102, 2);
+  hostMicros = 100*PERIOD + OFFSET + STREAM_DELAY_US - 1;
+  inputStream.play();
+  CHECK(waveforms[0].inputs.empty()); // not due yet
+  for (unsigned long seq = 100; seq < 106; seq++) {
+    playAt(seq);
+  }
+  CHECK_EQ(waveforms[0].inputs.size(), 6);
+  for (size_t i = 0; i < waveforms[0].inputs.size(); i++) {
+    CHECK_EQ(waveforms[0].inputs[i], (100 + i)*10);
+  }
+  CHECK_EQ(inputStream.getLost(), 0);
+  CHECK_EQ(inputStream.getLate(), 0);
+}
+
+static void testLoss() {
+  unsigned long lost = inputStream.getLost();
+  restart(inputStream);
+  receive(0, 200, 2);
+  receive(0, 204, 2); // 202 and 203 lost
+  playAt(200);
+  playAt(201);
+  playAt(202);        // 202 is missing, nothing later is due yet
+  CHECK_EQ(waveforms[0].inputs.size(), 2);
+  CHECK_EQ(inputStream.getLost() - lost, 0);
+  playAt(204);        // skips the missing ones
+  CHECK_EQ(waveforms[0].inputs.size(), 3);
+  CHECK_EQ(waveforms[0].inputs.back(), 2040);
+  CHECK_EQ(inputStream.getLost() - lost, 2);
+  playAt(206);
+  CHECK_EQ(waveforms[0].inputs.size(), 4);
+  CHECK_EQ(waveforms[0].inputs.back(), 2050);
+  receive(0, 206, 2);
+  playAt(207);        // two samples due at once, the newest plays
+  CHECK_EQ(waveforms[0].inputs.size(), 5);
+  CHECK_EQ(waveforms[0].inputs.back(), 2070);
+  CHECK_EQ(inputStream.getLost() - lost, 2);
+}
+
+static void testLate() {
+  unsigned long late = inputStream.getLate();
+  restart(inputStream);
+  receive(0, 300, 4);
+  playAt(303);
+  receive(0, 302, 1); // already played past
+  CHECK_EQ(inputStream.getLate() - late, 1);
+  CHECK_EQ(waveforms[0].inputs.back(), 3030);
+}
+
+static void testOverflow() {
+  unsigned long lost = inputStream.getLost();
+  restart(inputStream);
+  for (unsigned long seq = 400; seq < 400 + STREAM_BUFFER + 8; seq += 8) {
+    receive(0, seq, 8);
+  }
+  CHECK_EQ(inputStream.getLost() - lost, 8); // oldest samples dropped
+  playAt(408);
+  CHECK_EQ(waveforms[0].inputs.back(), 4080);
+}
+
+static void testEcho() {
+  restart(inputStream);
+  receive(STREAM_ECHO, 500, 2);
+  playAt(500);
+  playAt(501);
+  inputStream.handle();
+  CHECK_EQ(WiFiUDP::sent.size(), 2);
+  for (size_t i = 0; i < WiFiUDP::sent.size(); i++) {
+    std::vector<byte> &e = WiFiUDP::sent[i];
+    CHECK_EQ(e.size(), STREAM_ECHO_SIZE);
+    CHECK((e[0] == 'I') && (e[1] == 'E') && (e[2] == 0));
+    CHECK_EQ(getLong(e, 4), 500 + i);
+    CHECK_EQ(getLong(e, 8), STREAM_DELAY_US - (i == 0 ? PERIOD : 0)); // arrival to playout, both arrived with 501
+  }
+}
+
+int main() {
+  testOrder();
+  testLoss();
+  testLate();
+  testOverflow();
+  testEcho();
+  return testResult("test_stream");
+}
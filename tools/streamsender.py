@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+IOTDimmer - streamsender
+Reference sender for the UDP input stream (STREAM_PORT) of the input effect
+Version 0.80
+17-10-2026
+Copyright: Ivo Helwegen
+
+Sends a sine, or integers read from stdin (one per line), as timestamped
+samples with sequence numbers. See InputStream.h for the packet format.
+With --loopback the dimmer echoes every sample it plays out, with the time
+it was held in the jitter buffer; the sender reports the hold time, the
+network round trip and the samples that were never played (lost or late).
+
+  streamsender.py iotdimmer.local --rate 100 --batch 2 --amplitude 40 --freq 0.5
+  some_source | streamsender.py 192.168.1.20 --stdin
+  streamsender.py iotdimmer.local --loopback --report 10
+"""
+
+import argparse
+import math
+import socket
+import struct
+import sys
+import threading
+import time
+
+STREAM_PACKET = 32  # maximum samples per packet
+STREAM_ECHO = 0x80  # channel flag, echo played samples
+ECHO_TIMEOUT = 2.0  # [s] not echoed after this is counted as not played
+
+
+class Loopback:
+    """Matches echoes to sent samples, 'I' 'E' channel 0 seq(32) hold(32)"""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.lock = threading.Lock()
+        self.sent = {}  # seq: send time
+        self.reset()
+        threading.Thread(target=self.receive, daemon=True).start()
+
+    def reset(self):
+        self.echoed = 0
+        self.missing = 0
+        self.hold = []
+        self.network = []
+
+    def send(self, seq, count):
+        now = time.monotonic()
+        with self.lock:
+            for i in range(count):
+                self.sent[(seq + i) & 0xFFFFFFFF] = now
+
+    def receive(self):
+        while True:
+            data = self.sock.recv(64)
+            now = time.monotonic()
+            if len(data) != 12 or data[:2] != b"IE":
+                continue
+            seq, hold = struct.unpack("<II", data[4:12])
+            with self.lock:
+                sent = self.sent.pop(seq, None)
+                if sent is None:
+                    continue
+                self.echoed += 1
+                self.hold.append(hold / 1000.0)
+                self.network.append((now - sent) * 1000.0 - hold / 1000.0)
+
+    def report(self):
+        now = time.monotonic()
+        with self.lock:
+            old = [seq for seq, sent in self.sent.items() if now - sent > ECHO_TIMEOUT]
+            for seq in old:
+                del self.sent[seq]
+            self.missing += len(old)
+            line = "echoed %d, not played %d" % (self.echoed, self.missing)
+            for name, values in (("hold", self.hold), ("round trip", self.network)):
+                if values:
+                    line += ", %s min/avg/max %.1f/%.1f/%.1f ms" % (
+                        name, min(values), sum(values) / len(values), max(values))
+            self.reset()
+        print(line, flush=True)
+
+
+def samples_sine(amplitude, freq, rate):
+    n = 0
+    while True:
+        yield int(round(amplitude * math.sin(2 * math.pi * freq * n / rate)))
+        n += 1
+
+
+def samples_stdin():
+    for line in sys.stdin:
+        line = line.strip()
+        if line:
+            yield int(float(line))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="IOTDimmer input stream sender")
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=4210)
+    parser.add_argument("--channel", type=int, default=0)
+    parser.add_argument("--rate", type=float, default=100.0, help="samples per second")
+    parser.add_argument("--batch", type=int, default=2, help="samples per packet")
+    parser.add_argument("--amplitude", type=float, default=40.0)
+    parser.add_argument("--freq", type=float, default=0.5, help="sine frequency [Hz]")
+    parser.add_argument("--stdin", action="store_true", help="read samples from stdin")
+    parser.add_argument("--loopback", action="store_true", help="ask for echoes and report playout")
+    parser.add_argument("--report", type=float, default=5.0, help="loopback report interval [s]")
+    args = parser.parse_args()
+
+    batch = max(1, min(args.batch, STREAM_PACKET))
+    period = int(round(1e6 / args.rate))
+    source = samples_stdin() if args.stdin else samples_sine(args.amplitude, args.freq, args.rate)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    address = (socket.gethostbyname(args.host), args.port)
+    loopback = Loopback(sock) if args.loopback else None
+    channel = args.channel | (STREAM_ECHO if args.loopback else 0)
+    reported = time.monotonic()
+
+    seq = 0
+    start = time.monotonic()
+    values = []
+    for value in source:
+        if not values:
+            if args.stdin:
+                first = time.monotonic()
+            else:  # samples on a fixed time grid, sent when the last one is due
+                first = start + seq * period / 1e6
+            stamp = int(first * 1e6) & 0xFFFFFFFF  # sender clock of the first sample
+        values.append(max(-32768, min(32767, value)))
+        if len(values) < batch:
+            continue
+        if not args.stdin:  # stdin is paced by its producer
+            delay = first + (len(values) - 1) * period / 1e6 - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        packet = struct.pack("<2sBBIIH", b"IS", channel, len(values), seq & 0xFFFFFFFF, stamp, period)
+        packet += struct.pack("<%dh" % len(values), *values)
+        if loopback:
+            loopback.send(seq, len(values))
+            if time.monotonic() - reported >= args.report:
+                reported = time.monotonic()
+                loopback.report()
+        sock.sendto(packet, address)
+        seq += len(values)
+        values = []
+
+
+if __name__ == "__main__":
+    main()